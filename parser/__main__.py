@@ -6,16 +6,26 @@
 Entry point for the pyqtc worker.
 """
 
+import contextlib
 import logging
+import optparse
 import os
 import sys
+import threading
 import rope.base.project
-from rope.base import worder
-from rope.contrib import codeassist
+from rope.base import exceptions, pyobjects, worder
+from rope.contrib import codeassist, fixsyntax
+from rope.refactor import functionutils
 
+import autoimportindex
+import libraryindex
 import messagehandler
+import modulecache
 import rpc_pb2
+import sqliteobjectdb
+import stdlibsummary
 import symbolindex
+import worderaccel
 
 
 class ProjectNotFoundError(Exception):
@@ -26,12 +36,82 @@ class ProjectNotFoundError(Exception):
 
 class Project(object):
   """
-  Helper object that contains a rope project and an associated symbol index.
+  Helper object that contains a rope project and an associated symbol index
+  and auto-import index.
   """
 
   def __init__(self, rope_project):
     self.rope_project = rope_project
     self.symbol_index = symbolindex.SymbolIndex(rope_project)
+    self.autoimport_index = autoimportindex.AutoImportIndex(self.symbol_index)
+
+    # Held by the background thread while it indexes, so the indexes aren't
+    # closed underneath it.
+    self.index_lock = threading.Lock()
+    self.closed = False
+
+    # Set by Close, and held while it's set or checked, so a close requested
+    # while indexing is running is always done by one thread or the other.
+    self.close_lock = threading.Lock()
+    self.close_requested = False
+    self.on_closed = None
+
+  @contextlib.contextmanager
+  def Indexing(self):
+    """
+    Holds index_lock while the background thread indexes, and closes the
+    project afterwards if Close was called in the meantime.
+    """
+
+    with self.index_lock:
+      if self.closed:
+        raise ProjectNotFoundError(self.rope_project.address)
+
+      try:
+        yield
+      finally:
+        with self.close_lock:
+          if self.close_requested:
+            self._Close()
+
+  def Close(self, on_closed=None):
+    """
+    Closes the rope project and the indexes, and calls on_closed.  If the
+    background thread is indexing they're closed when it finishes instead, so
+    this never waits for it.
+    """
+
+    with self.close_lock:
+      self.close_requested = True
+      self.on_closed = on_closed
+      if not self.index_lock.acquire(False):
+        return
+
+    try:
+      self._Close()
+    finally:
+      self.index_lock.release()
+
+  def _Close(self):
+    self.closed = True
+    self.symbol_index.Close()
+    self.rope_project.close()
+
+    if self.on_closed is not None:
+      self.on_closed()
+
+  def AfterFork(self):
+    """
+    Opens new database connections in a forked child.
+    """
+
+    self.index_lock = threading.Lock()
+    self.close_lock = threading.Lock()
+    self.symbol_index.AfterFork()
+
+    objectdb = self.rope_project.pycore.object_info.objectdb.db
+    if isinstance(objectdb, sqliteobjectdb.SqliteDB):
+      objectdb.AfterFork()
 
 
 class Handler(messagehandler.MessageHandler):
@@ -57,11 +137,71 @@ class Handler(messagehandler.MessageHandler):
   }
 
   MAXFIXES = 10
-
-  def __init__(self):
-    super(Handler, self).__init__(rpc_pb2.Message)
+  MAX_PROPOSALS = 200
+  MAX_AUTOIMPORT_PROPOSALS = 50
+
+  # Indexing can take minutes, so do it without holding up completion and
+  # searches.
+  BACKGROUND_REQUESTS = frozenset([
+    "rebuild_symbol_index_request",
+    "update_symbol_index_request",
+  ])
+
+  # Cancelling a rebuild mustn't wait for a completion to finish.
+  IMMEDIATE_REQUESTS = messagehandler.MessageHandler.IMMEDIATE_REQUESTS | \
+                       frozenset(["cancel_index_request"])
+
+  # Requests that don't change any state, which can be handled in forked
+  # children when that's enabled.
+  FORKED_REQUESTS = frozenset([
+    "completion_request",
+    "definition_location_request",
+    "search_request",
+    "symbol_info_request",
+    "tooltip_request",
+  ])
+
+  def __init__(self, max_children=0):
+    super(Handler, self).__init__(rpc_pb2.Message, max_children)
 
     self.projects = {}
+    self.libraries = libraryindex.LibraryIndexes()
+    self.searcher = symbolindex.SymbolSearcher()
+
+    self.module_cache = modulecache.ModuleCache()
+    self.module_cache.Install()
+
+    sqliteobjectdb.SqliteDB.Install()
+    symbolindex.SetForkHooks(self.CanFork, self.AfterPoolFork)
+    stdlibsummary.StdlibSummaries().Install()
+    worderaccel.WorderAccelerator().Install()
+
+    # Roots of the projects whose rebuilds should stop.  Added to by the reader
+    # thread and checked by the background thread.
+    self.cancelled_indexing = set()
+
+  def AfterFork(self):
+    """
+    Replaces the locks and database connections the background threads use.
+    """
+
+    super(Handler, self).AfterFork()
+
+    self.libraries.AfterFork()
+    self.searcher.AfterFork()
+    for project in self.projects.itervalues():
+      project.AfterFork()
+
+  def CanFork(self):
+    """
+    The library indexes are built in SQLite databases on a thread of their
+    own, so other threads don't fork until they're finished.
+    """
+
+    if self.libraries.Building() and \
+       threading.current_thread() is not self.libraries.thread:
+      return False
+    return super(Handler, self).CanFork()
 
   def CreateProjectRequest(self, request, _response):
     """
@@ -72,6 +212,11 @@ class Handler(messagehandler.MessageHandler):
     project = rope.base.project.Project(root)
 
     self.projects[root] = Project(project)
+    self.module_cache.Watch(project.pycore)
+    self.searcher.Add(self.projects[root].symbol_index.db_filename, root)
+
+    # Index the standard library and site-packages if that hasn't been done
+    self.libraries.Start()
 
   def DestroyProjectRequest(self, request, _response):
     """
@@ -81,9 +226,16 @@ class Handler(messagehandler.MessageHandler):
     root = os.path.normpath(request.project_root)
     project = self.projects[root]
 
-    project.rope_project.close()
+    self.module_cache.Unwatch(project.rope_project.pycore)
+    self.searcher.Remove(project.symbol_index.db_filename)
     del self.projects[root]
 
+    # Stop a rebuild that's running on the background thread.  The project is
+    # closed when it finishes, without waiting for it here.
+    self.cancelled_indexing.add(request.project_root)
+    project.Close(
+        lambda: self.cancelled_indexing.discard(request.project_root))
+
   def _Context(self, context):
     """
     Returns a (project, resource, source, offset) tuple for the context.
@@ -133,17 +285,13 @@ class Handler(messagehandler.MessageHandler):
       paren_start = word_finder.find_parens_start_from_inside(offset)
 
       # Get a calltip now
-      calltip = codeassist.get_calltip(project, source, paren_start-1,
-                                       maxfixes=self.MAXFIXES,
-                                       resource=resource,
-                                       remove_self=True)
-
-      if calltip is not None:
+      if self._Signature(project, resource, source, paren_start-1,
+                         response.signature):
         response.insertion_position = paren_start + 1
-        response.calltip = calltip
         return
 
-    # Do normal completion if a calltip couldn't be found
+    # Do normal completion if a calltip couldn't be found.  rope only returns
+    # names that start with what has been typed so far.
     proposals = codeassist.code_assist(project, source, offset,
                                        maxfixes=self.MAXFIXES,
                                        resource=resource)
@@ -153,6 +301,19 @@ class Handler(messagehandler.MessageHandler):
     starting_offset = codeassist.starting_offset(source, offset)
     response.insertion_position = starting_offset
 
+    # Names that don't need importing, including any that are left out below.
+    in_scope = set(x.name for x in proposals)
+
+    # Only send the best proposals.  If some were left out the client has to
+    # ask again once more of the name has been typed.
+    max_proposals = self.MAX_PROPOSALS
+    if request.HasField("max_proposals"):
+      max_proposals = request.max_proposals
+
+    if max_proposals > 0 and len(proposals) > max_proposals:
+      proposals = proposals[:max_proposals]
+      response.incomplete = True
+
     # Construct the response protobuf
     for proposal in proposals:
       proposal_pb = response.proposal.add()
@@ -169,6 +330,130 @@ class Handler(messagehandler.MessageHandler):
       if docstring is not None:
         proposal_pb.docstring = docstring
 
+    self._AddAutoImportProposals(request, word_finder, resource, source,
+                                 starting_offset, offset, in_scope,
+                                 max_proposals, response)
+
+  def _AddAutoImportProposals(self, request, word_finder, resource, source,
+                              starting_offset, offset, in_scope,
+                              max_proposals, response):
+    """
+    Adds proposals for global names in other modules of the project that start
+    with the name being typed, and aren't in scope already, as long as there
+    are fewer than max_proposals proposals.  Each one carries the import
+    statement the plugin inserts when it's picked.
+    """
+
+    prefix = source[starting_offset:offset]
+    if not prefix:
+      return
+
+    limit = self.MAX_AUTOIMPORT_PROPOSALS
+    if max_proposals > 0:
+      limit = min(limit, max_proposals - len(response.proposal))
+      if limit <= 0 and response.incomplete:
+        return
+
+    # Only for bare names, not attributes or names in import statements
+    before = word_finder.code_finder._find_last_non_space_char(
+        starting_offset - 1)
+    if (before >= 0 and source[before] == ".") or \
+       word_finder.is_import_statement(offset) or \
+       word_finder.is_from_statement(offset):
+      return
+
+    this_module = None
+    if resource is not None:
+      this_module = resource.project.pycore.modname(resource)
+
+    index = self._ProjectForFile(request.context.file_path).autoimport_index
+    names, incomplete = index.Search(
+        prefix, max(limit, 0),
+        lambda name, module: name in in_scope or module == this_module)
+
+    if incomplete:
+      response.incomplete = True
+    if not names:
+      return
+
+    import_position = autoimportindex.ImportPosition(source, starting_offset)
+
+    for name, module in names:
+      proposal_pb = response.proposal.add()
+      proposal_pb.name = name
+      proposal_pb.scope = rpc_pb2.CompletionResponse.Proposal.GLOBAL
+      proposal_pb.module = module
+      proposal_pb.import_text = "from %s import %s\n" % (module, name)
+      proposal_pb.import_position = import_position
+
+  def _PyNameAt(self, project, resource, source, offset):
+    """
+    Fixes any syntax errors in source and returns the pyname at offset, or None.
+    """
+
+    fixer = fixsyntax.FixSyntax(project.pycore, source, resource,
+                                self.MAXFIXES)
+    fixer.get_pymodule()
+    return fixer.pyname_at(offset)
+
+  def _Signature(self, project, resource, source, offset, signature_pb):
+    """
+    Fills signature_pb with the signature of the callable at offset.  Returns
+    False if there was nothing callable there.
+    """
+
+    pyname = self._PyNameAt(project, resource, source, offset)
+    if pyname is None:
+      return False
+
+    return self._FillSignature(pyname.get_object(), signature_pb)
+
+  @staticmethod
+  def _FillSignature(pyobject, signature_pb):
+    """
+    Fills signature_pb with the signature of the function pyobject, or of its
+    __init__ or __call__ method.  The parameters are sent one by one so the
+    plugin never has to split them again.
+    """
+
+    try:
+      if isinstance(pyobject, pyobjects.AbstractClass):
+        pyobject = pyobject["__init__"].get_object()
+      if not isinstance(pyobject, pyobjects.AbstractFunction):
+        pyobject = pyobject["__call__"].get_object()
+    except exceptions.AttributeNotFoundError:
+      return False
+
+    if not isinstance(pyobject, pyobjects.AbstractFunction):
+      return False
+
+    extractor = codeassist.PyDocExtractor()
+
+    if isinstance(pyobject, pyobjects.PyFunction):
+      info = functionutils.DefinitionInfo.read(pyobject)
+      parameters = []
+      for arg, default in info.args_with_defaults:
+        if default is not None:
+          parameters.append("%s=%s" % (arg, default))
+        else:
+          parameters.append(arg)
+      if info.args_arg is not None:
+        parameters.append("*" + info.args_arg)
+      if info.keywords_arg:
+        parameters.append("**" + info.keywords_arg)
+    elif isinstance(pyobject, stdlibsummary.SummaryFunction):
+      parameters = list(pyobject.parameters)
+    else:
+      parameters = list(pyobject.get_param_names())
+
+    if extractor._is_method(pyobject) and parameters[:1] == ["self"]:
+      parameters = parameters[1:]
+
+    signature_pb.scope = extractor._location(pyobject, add_module=True)
+    signature_pb.name = pyobject.get_name()
+    signature_pb.parameter.extend(parameters)
+    return True
+
   def TooltipRequest(self, request, response):
     """
     Finds and returns a tooltip for the given location in the given source file.
@@ -197,66 +482,143 @@ class Handler(messagehandler.MessageHandler):
     if offset is not None:
       response.line = offset
 
-  def RebuildSymbolIndexRequest(self, request, _response):
+  def SymbolInfoRequest(self, request, response):
     """
-    Parses all the files in the project and rebuilds the symbol index.
+    Finds the docstring, definition location and signature of the current
+    symbol, evaluating it only once.
     """
 
-    project = self.projects[request.project_root]
-    project.symbol_index.Rebuild()
+    project, resource, source, offset = self._Context(request.context)
+    pyname = self._PyNameAt(project, resource, source, offset)
+    if pyname is None:
+      return
+
+    pyobject = pyname.get_object()
+
+    docstring = codeassist.PyDocExtractor().get_doc(pyobject)
+    if docstring is not None:
+      response.rich_text = docstring
+
+    module, line = pyname.get_definition_location()
+    if module is not None:
+      definition_resource = module.get_module().get_resource()
+      if definition_resource is not None:
+        response.file_path = definition_resource.real_path
+      if line is not None:
+        response.line = line
+
+    self._FillSignature(pyobject, response.signature)
 
-  def UpdateSymbolIndexRequest(self, request, _response):
+  def RebuildSymbolIndexRequest(self, request, response):
     """
-    Parses just one file in the project and updates the symbol index.
+    Brings the project's symbol index and auto-import index up to date,
+    parsing any files that changed since it was last opened.  Sends
+    IndexProgress messages as it goes, and stops early if a CancelIndexRequest
+    arrives.
     """
 
-    project = self._ProjectForFile(request.file_path)
+    root = request.project_root
+    project = self.projects[root]
+
+    def Progress(files_done, files_total):
+      message = rpc_pb2.Message()
+      message.index_progress.project_root = root
+      message.index_progress.files_done = files_done
+      message.index_progress.files_total = files_total
+      self.SendNotification(message)
 
-    # Make the file_path relative to the project
-    relative_path = os.path.relpath(
-        request.file_path, project.rope_project.address)
+    def Cancelled():
+      return root in self.cancelled_indexing
 
-    project.symbol_index.UpdateFile(relative_path)
+    with project.Indexing():
+      try:
+        if not (project.symbol_index.Refresh(Progress, Cancelled) and
+                project.autoimport_index.Refresh(Cancelled)):
+          response.cancelled = True
+      finally:
+        self.cancelled_indexing.discard(root)
+
+      response.symbol_table_path = project.symbol_index.ExportTable()
+
+    self._AddLibraryTables(response)
+
+  def CancelIndexRequest(self, request, _response):
+    """
+    Stops a rebuild of the project's symbol index after the current batch of
+    files.
+    """
+
+    self.cancelled_indexing.add(request.project_root)
+
+  def UpdateSymbolIndexRequest(self, request, response):
+    """
+    Parses just the given files in the project and updates the symbol index
+    and auto-import index.  The symbol table is only rewritten as a whole once
+    enough files have changed, see SymbolIndex.ExportOverlay.
+    """
+
+    project = self.projects[request.project_root]
+
+    # Make the file paths relative to the project
+    file_paths = [os.path.relpath(x, project.rope_project.address)
+                  for x in request.file_path]
+
+    with project.Indexing():
+      project.symbol_index.UpdateFiles(file_paths)
+      project.autoimport_index.UpdateFiles(file_paths)
+
+      table_path, overlay_path = \
+          project.symbol_index.ExportOverlay(file_paths)
+      response.symbol_table_path = table_path
+      if overlay_path is not None:
+        response.symbol_overlay_path = overlay_path
+
+    self._AddLibraryTables(response)
+
+  def _AddLibraryTables(self, response):
+    """
+    Adds the symbol tables of the library indexes that are finished to a
+    Rebuild or UpdateSymbolIndexResponse.
+    """
+
+    for library in self.libraries.Ready():
+      response.library_table_path.append(library.table_filename)
 
   def SearchRequest(self, request, response):
     """
     Searches the symbol index.
     """
 
+    symbol_type = None
+    if request.HasField("symbol_type") and request.symbol_type != rpc_pb2.ALL:
+      symbol_type = request.symbol_type
+
     # If a file_path was provided, only search in the project that owns it.
-    # Otherwise search all the projects.
+    # Otherwise search all the projects and libraries in one go.
     if request.HasField("file_path"):
-      projects = [self._ProjectForFile(request.file_path)]
-    else:
-      projects = self.projects.values()
+      project = self._ProjectForFile(request.file_path)
 
-    for project in projects:
-      project_dir = project.rope_project.address
+      # Make the file_path relative to the project
+      file_path = os.path.relpath(
+          request.file_path, project.rope_project.address)
 
-      file_path = None
-      symbol_type = None
-
-      if request.HasField("file_path"):
-        # Make the file_path relative to the project
-        file_path = os.path.relpath(
-            request.file_path, project_dir)
-
-      if request.HasField("symbol_type") and request.symbol_type != rpc_pb2.ALL:
-        symbol_type = request.symbol_type
-
-      # Do the query
       results = project.symbol_index.Search(request.query,
           file_path=file_path, symbol_type=symbol_type)
+    else:
+      for library in self.libraries.Ready():
+        self.searcher.Add(library.db_filename, library.root)
+
+      results = self.searcher.Search(request.query, symbol_type=symbol_type)
 
-      # Create the response
-      for module_name, file_path, line_number, symbol_name, symbol_type in results:
-        result_pb = response.result.add()
+    # Create the response
+    for module_name, file_path, line_number, symbol_name, result_type in results:
+      result_pb = response.result.add()
 
-        result_pb.module_name = module_name
-        result_pb.file_path   = os.path.join(project_dir, file_path)
-        result_pb.line_number = line_number
-        result_pb.symbol_name = symbol_name
-        result_pb.symbol_type = symbol_type
+      result_pb.module_name = module_name
+      result_pb.file_path   = file_path
+      result_pb.line_number = line_number
+      result_pb.symbol_name = symbol_name
+      result_pb.symbol_type = result_type
 
 
 def Main(args):
@@ -264,9 +626,29 @@ def Main(args):
   Connects to the socket passed on the commandline and listens for requests.
   """
 
-  logging.basicConfig()
-
-  handler = Handler()
+  parser = optparse.OptionParser(usage="%prog [options] socket")
+  parser.add_option("--fork-children", type="int", default=0, metavar="N",
+                    help="handle up to N read-only requests at once in "
+                         "forked children (default: handle them in order)")
+  parser.add_option("--log-level", default="warning",
+                    choices=["debug", "info", "warning", "error"],
+                    help="debug logs requests and responses "
+                         "(default: %default)")
+  parser.add_option("--log-every", type="int", default=1, metavar="N",
+                    help="log only one in every N requests")
+  parser.add_option("--log-payload-size", type="int", default=200,
+                    metavar="N", help="cut logged strings to N characters")
+  options, args = parser.parse_args(args)
+  if len(args) != 1:
+    parser.error("expected the socket name")
+
+  logging.basicConfig(
+      level=getattr(logging, options.log_level.upper()),
+      format="%(asctime)s %(levelname)s %(name)s %(message)s")
+
+  handler = Handler(max_children=options.fork_children)
+  handler.log_every = max(1, options.log_every)
+  handler.log_payload_size = options.log_payload_size
   handler.ServeForever(args[0])
 
 
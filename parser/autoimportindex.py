@@ -0,0 +1,147 @@
+# Ignore access to protected members pylint: disable=W0212
+
+"""
+Finds the modules in a project that define a global name, so names that
+haven't been imported yet can be completed.
+"""
+
+import bisect
+import StringIO
+import tokenize
+
+
+def ImportPosition(source, offset):
+  """
+  Returns the offset in source to insert an import for a name being completed
+  at offset: after the last top-level import above that line, or else after
+  the module's docstring or leading comments, or else at the start.
+  """
+
+  # Only the lines above the name, so the import never moves it.
+  source = source[:source.rfind("\n", 0, offset) + 1]
+
+  line_offsets = [0]
+  for line in source.splitlines(True):
+    line_offsets.append(line_offsets[-1] + len(line))
+
+  position = 0
+  first_statement = True
+  statement_start = True
+  statement_wanted = False
+
+  try:
+    for token_type, token, start, end, _ in tokenize.generate_tokens(
+        StringIO.StringIO(source).readline):
+      if token_type == tokenize.COMMENT and first_statement:
+        # Keep the #! and coding lines first.
+        position = line_offsets[start[0]]
+        continue
+      if token_type in (tokenize.COMMENT, tokenize.NL, tokenize.INDENT,
+                        tokenize.DEDENT, tokenize.ENDMARKER):
+        continue
+
+      if statement_start:
+        statement_wanted = start[1] == 0 and (
+            token in ("import", "from") or
+            (first_statement and token_type == tokenize.STRING))
+        statement_start = False
+        first_statement = False
+
+      if token_type == tokenize.NEWLINE:
+        if statement_wanted:
+          position = line_offsets[end[0]]
+        statement_start = True
+  except (tokenize.TokenError, IndentationError):
+    # The rest of the source is incomplete.
+    pass
+
+  return position
+
+
+class AutoImportIndex(object):
+  """
+  Keeps a sorted index of the global names defined by each module in the
+  project, for looking them up by prefix.
+
+  The symbol index finds the names while it parses each file for its own
+  symbols, and keeps them in its database, so nothing is parsed again here.
+  rope's AutoImport.import_assist also scans every name of every module,
+  which takes tens of milliseconds on large projects.  Search bisects the
+  sorted index instead, so it only looks at the names it returns.
+
+  Refresh and UpdateFiles are called from the background thread after the
+  symbol index's, and replace the index in one assignment, so Search can run
+  at the same time from any thread.
+  """
+
+  # Refresh checks whether it was cancelled after this many modules.
+  CANCEL_CHECK_INTERVAL = 500
+
+  def __init__(self, symbol_index):
+    self.symbol_index = symbol_index
+
+    # module name -> [global name]
+    self.names = {}
+
+    # (sorted names, module of each name)
+    self.index = ([], [])
+
+  def Refresh(self, cancelled=None):
+    """
+    Loads the names of every module in the symbol index, which must have just
+    been refreshed.  If cancelled returns True first the index is left as it
+    was and this returns False, otherwise it returns True.
+    """
+
+    names = {}
+    for i, (module, global_names) in enumerate(
+        self.symbol_index.GlobalNames()):
+      if cancelled is not None and i % self.CANCEL_CHECK_INTERVAL == 0 and \
+         cancelled():
+        return False
+      names[module] = global_names
+
+    self.names = names
+    self._BuildIndex()
+    return True
+
+  def UpdateFiles(self, file_paths):
+    """
+    Loads the names of the given files, relative to the project root, after
+    the symbol index updated them.  Modules of files that are no longer in the
+    symbol index are removed.
+    """
+
+    project = self.symbol_index._ParseProject()
+    for file_path in file_paths:
+      self.names.pop(project.pycore.modname(project.get_file(file_path)), None)
+
+    self.names.update(self.symbol_index.GlobalNames(file_paths))
+    self._BuildIndex()
+
+  def Search(self, prefix, limit, skip=None):
+    """
+    Returns a list of up to limit (name, module) tuples for global names that
+    start with prefix, sorted by name, and whether any were left out.  Names
+    for which skip(name, module) is true are left out without counting.
+    """
+
+    names, modules = self.index
+
+    ret = []
+    i = bisect.bisect_left(names, prefix)
+    while i < len(names) and names[i].startswith(prefix):
+      if skip is None or not skip(names[i], modules[i]):
+        if len(ret) >= limit:
+          return ret, True
+        ret.append((names[i], modules[i]))
+      i += 1
+    return ret, False
+
+  def _BuildIndex(self):
+    entries = sorted(
+        (name, module)
+        for module, names in self.names.iteritems()
+        for name in names)
+
+    self.index = ([x[0] for x in entries], [x[1] for x in entries])
@@ -0,0 +1,284 @@
+"""
+Builds and finds the shared symbol indexes of the standard library and the
+installed third party packages.
+"""
+
+import collections
+import errno
+import hashlib
+import logging
+import os
+import os.path
+import re
+import shutil
+import sys
+import threading
+
+from distutils import sysconfig
+
+import rope.base.project
+
+import symbolindex
+
+
+LibraryIndex = collections.namedtuple("LibraryIndex",
+    ["root", "db_filename", "table_filename"])
+
+
+def DefaultCacheDirectory():
+  """
+  Returns the directory the library indexes are stored in.
+  """
+
+  cache_home = os.environ.get("XDG_CACHE_HOME") or \
+               os.path.join(os.path.expanduser("~"), ".cache")
+  return os.path.join(cache_home, "pyqtc", "libraries")
+
+
+def LibraryDirectories():
+  """
+  Returns the standard library and site-packages directories of the running
+  interpreter that exist.
+  """
+
+  candidates = [
+    sysconfig.get_python_lib(standard_lib=True),
+    sysconfig.get_python_lib(),
+  ]
+
+  # Not available in a virtualenv
+  try:
+    import site
+    candidates += site.getsitepackages()
+    candidates.append(site.getusersitepackages())
+  except AttributeError:
+    pass
+
+  ret = []
+  for directory in candidates:
+    directory = os.path.realpath(directory)
+    if os.path.isdir(directory) and directory not in ret:
+      ret.append(directory)
+  return ret
+
+
+def InstalledDistributions(directories):
+  """
+  Returns a dict of sorted lists of "name==version" strings for the packages
+  installed in each of the directories.  Each package is only listed under the
+  innermost directory that contains it, so the standard library doesn't get
+  the packages of a site-packages inside it.  The lists are empty if setuptools
+  isn't available.
+  """
+
+  ret = dict((x, []) for x in directories)
+
+  try:
+    import pkg_resources
+  except ImportError:
+    return ret
+
+  for distribution in pkg_resources.working_set:
+    # Eggs are directories of their own inside the library directory
+    location = os.path.realpath(distribution.location or "")
+    containing = [x for x in directories
+                  if location == x or location.startswith(x + os.sep)]
+    if containing:
+      ret[max(containing, key=len)].append(
+          "%s==%s" % (distribution.project_name, distribution.version))
+
+  for distributions in ret.itervalues():
+    distributions.sort()
+  return ret
+
+
+class LibraryIndexes(object):
+  """
+  The symbol indexes of the library directories of the interpreter running
+  the worker.  Each directory has its own index, stored outside of any project
+  under a name that changes when the interpreter or the packages installed in
+  that directory change, so each is only built once and shared by every
+  project and worker.  Indexes are built on a background thread and never
+  change once built.  Building a new index of a directory deletes the old
+  ones.
+  """
+
+  # The standard library directory contains site-packages on some systems.
+  # Tests are large and nobody wants to jump to them.
+  IGNORED_RESOURCES = [
+    "*.pyc", "*~", ".svn", ".hg", ".git", "CVS",
+    "site-packages", "dist-packages", "test", "tests",
+  ]
+
+  OLD_KEY_RE = re.compile(r"^[0-9a-f]{40}$")
+
+  def __init__(self, cache_directory=None):
+    self.cache_directory = cache_directory or DefaultCacheDirectory()
+
+    self.lock = threading.Lock()
+    self.ready = []
+    self.thread = None
+
+  def Start(self):
+    """
+    Starts building any indexes that don't exist yet on a background thread.
+    Does nothing if it was already started.
+    """
+
+    if self.thread is not None:
+      return
+
+    self.thread = threading.Thread(target=self._BuildAll,
+                                   name="LibraryIndexes")
+    self.thread.daemon = True
+    self.thread.start()
+
+  def AfterFork(self):
+    """
+    Replaces the lock in a forked child, where the building thread doesn't
+    exist and can't release it.
+    """
+
+    self.lock = threading.Lock()
+
+  def Building(self):
+    """
+    Returns True while the background thread is building indexes.
+    """
+
+    return self.thread is not None and self.thread.is_alive()
+
+  def Ready(self):
+    """
+    Returns a list of LibraryIndex tuples for the indexes that are finished.
+    """
+
+    with self.lock:
+      return list(self.ready)
+
+  def _BuildAll(self):
+    """
+    Builds the index of each library directory in turn.
+    """
+
+    roots = LibraryDirectories()
+    distributions = InstalledDistributions(roots)
+
+    for root in roots:
+      try:
+        library = self._Build(root, distributions[root])
+      except Exception:
+        logging.exception("Failed to index %s", root)
+        continue
+
+      with self.lock:
+        self.ready.append(library)
+
+  @staticmethod
+  def _RootKey(root):
+    """
+    Returns the part of the name of root's index that only depends on the
+    interpreter and root itself.
+    """
+
+    key = hashlib.sha1()
+    key.update(os.path.realpath(sys.executable))
+    key.update(sys.version)
+    key.update(root)
+    return key.hexdigest()
+
+  @staticmethod
+  def _ContentsKey(distributions):
+    """
+    Returns the part of the name of root's index that changes when packages
+    are installed in root.  The standard library only changes with the
+    interpreter, which is already part of the root key.
+    """
+
+    key = hashlib.sha1()
+    for distribution in distributions:
+      key.update(distribution)
+    return key.hexdigest()
+
+  def _Build(self, root, distributions):
+    """
+    Builds the index of root if it doesn't exist already and returns a
+    LibraryIndex tuple for it.  distributions are the packages installed in
+    root, from InstalledDistributions.
+    """
+
+    root_key = self._RootKey(root)
+    name = "%s-%s" % (root_key, self._ContentsKey(distributions))
+    directory = os.path.join(self.cache_directory, name)
+    library = LibraryIndex(
+        root,
+        os.path.join(directory, symbolindex.SymbolIndex.DATABASE_FILENAME),
+        os.path.join(directory, symbolindex.SymbolIndex.TABLE_FILENAME))
+
+    if os.path.exists(library.table_filename):
+      return library
+
+    # Build it somewhere else and move it into place when it's finished, so
+    # other workers never see a half built index.
+    temp_directory = "%s.%d" % (directory, os.getpid())
+    shutil.rmtree(temp_directory, ignore_errors=True)
+    os.makedirs(temp_directory)
+
+    logging.info("Indexing %s", root)
+
+    try:
+      project = rope.base.project.Project(
+          root, ropefolder=None, ignored_resources=self.IGNORED_RESOURCES)
+      try:
+        index = symbolindex.SymbolIndex(project, temp_directory)
+        try:
+          index.Refresh()
+          index.ExportTable()
+        finally:
+          index.Close()
+      finally:
+        project.close()
+    except:
+      shutil.rmtree(temp_directory, ignore_errors=True)
+      raise
+
+    try:
+      os.rename(temp_directory, directory)
+    except OSError:
+      # Another worker finished first
+      shutil.rmtree(temp_directory, ignore_errors=True)
+
+    self._RemoveStale(root_key, name)
+    return library
+
+  def _RemoveStale(self, root_key, name):
+    """
+    Deletes the indexes of the same root that aren't called name, and the
+    temporary directories of workers that died while building one.  Each
+    directory's name starts with its root key.  Workers
+    that still have an old index open keep using it until they exit.
+    """
+
+    for entry in os.listdir(self.cache_directory):
+      entry_name, _, pid = entry.partition(".")
+
+      # Indexes named before the key was split in two can't be matched to a
+      # root, so they all go.
+      if not self.OLD_KEY_RE.match(entry_name):
+        if not entry.startswith(root_key + "-") or entry == name:
+          continue
+
+      if pid and (not pid.isdigit() or self._IsRunning(int(pid))):
+        continue
+
+      logging.info("Removing old library index %s", entry)
+      shutil.rmtree(os.path.join(self.cache_directory, entry),
+                    ignore_errors=True)
+
+  @staticmethod
+  def _IsRunning(pid):
+    try:
+      os.kill(pid, 0)
+    except OSError, ex:
+      return ex.errno != errno.ESRCH
+    return True
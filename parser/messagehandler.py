@@ -3,11 +3,55 @@ Reads uint32 length-encoded protobufs from stdin, handles requests and writes
 responses to stdout.
 """
 
+import cStringIO
+import itertools
 import logging
+import os
+import Queue
 import re
+import select
+import signal
 import socket
 import struct
-import sys
+import threading
+import time
+
+# Requests and responses are logged here at DEBUG level.
+REQUEST_LOG = logging.getLogger("pyqtc.requests")
+
+# Number of items of a repeated field shown by Summarise.
+SUMMARY_REPEATED_ITEMS = 3
+
+
+def Summarise(message, max_length):
+  """
+  Returns a one line summary of a protobuf message for logging, with strings
+  longer than max_length and repeated fields cut short.
+  """
+
+  parts = []
+  for descriptor, value in message.ListFields():
+    if descriptor.label == descriptor.LABEL_REPEATED:
+      items = [_SummariseValue(descriptor, x, max_length)
+               for x in value[:SUMMARY_REPEATED_ITEMS]]
+      if len(value) > SUMMARY_REPEATED_ITEMS:
+        items.append("... %d more" % (len(value) - SUMMARY_REPEATED_ITEMS))
+      text = "[%s]" % ", ".join(items)
+    else:
+      text = _SummariseValue(descriptor, value, max_length)
+
+    parts.append("%s: %s" % (descriptor.name, text))
+
+  return "{%s}" % ", ".join(parts)
+
+
+def _SummariseValue(descriptor, value, max_length):
+  if descriptor.type == descriptor.TYPE_MESSAGE:
+    return Summarise(value, max_length)
+  if isinstance(value, basestring) and len(value) > max_length:
+    return "%r... (%d chars)" % (value[:max_length], len(value))
+  return repr(value)
+
 
 class ShortReadError(Exception):
   """
@@ -40,9 +84,63 @@ class MessageHandler(object):
   REQUEST_SUFFIX  = "_request"
   RESPONSE_SUFFIX = "_response"
 
-  def __init__(self, message_class):
+  # Names of request fields that are handled one at a time on a background
+  # thread, so they don't hold up other requests.  Their responses can be sent
+  # out of order.
+  BACKGROUND_REQUESTS = frozenset()
+
+  # Names of request fields that only read the handler's state.  If
+  # max_children is more than 0 each one is handled by a child process forked
+  # for it, which shares the parent's state copy-on-write, so up to
+  # max_children of them run at once.  Their responses can be sent out of
+  # order.  They're handled in the parent instead while a background request
+  # is running or CanFork returns False.
+  FORKED_REQUESTS = frozenset()
+
+  # Seconds a forked child has to send its response before it's killed.
+  CHILD_TIMEOUT = 30
+
+  # Names of request fields that are handled on the reader thread as soon as
+  # they arrive, even while another request is running.  They have to be quick
+  # and safe to handle alongside any other request.
+  IMMEDIATE_REQUESTS = frozenset(["cancel_request"])
+
+  def __init__(self, message_class, max_children=0):
     self.message_class = message_class
 
+    # When REQUEST_LOG is at DEBUG level one in every log_every requests is
+    # logged with its response, with strings cut to log_payload_size
+    # characters.  Nothing is formatted when it isn't.
+    self.log_every = 1
+    self.log_payload_size = 200
+    self.log_counter = itertools.count()
+
+    # Requests waiting for the main and background threads, and responses
+    # waiting for the writer thread in the order they were finished.
+    self.request_queue = Queue.Queue()
+    self.background_queue = Queue.Queue()
+    self.response_queue = Queue.Queue()
+    self.background_thread = None
+
+    # IDs of the requests in the queues, and of the ones among them that were
+    # cancelled.
+    self.queue_lock = threading.Lock()
+    self.queued_ids = set()
+    self.cancelled_ids = set()
+
+    self.max_children = max_children
+    self.child_slots = threading.BoundedSemaphore(max(1, max_children))
+
+    # Held by the background thread while it handles a request, and by the
+    # main thread while it forks.  A child forked in the middle of a request
+    # would get copies of the locks it holds, like SQLite's, that nothing in
+    # the child can ever release.
+    self.background_lock = threading.Lock()
+    self.background_busy = False
+
+    # The socket to the plugin, once ServeForever has connected.
+    self.socket = None
+
   def ReadMessage(self, handle):
     """
     Reads a uint32 length-encoded protobuf from the file handle and returns it.
@@ -108,42 +206,340 @@ class MessageHandler(object):
 
     raise UnknownRequestType
 
-  def ServeForever(self, socket_filename):
+  def HandleRequest(self, request):
     """
-    Connects to the given local socket and listens for incoming request
-    protobufs.  Handles the requests and writes the responses back to the
-    socket.
+    Handles one request and returns the response.
     """
 
-    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
-    sock.connect(socket_filename)
+    log = REQUEST_LOG.isEnabledFor(logging.DEBUG) and \
+          next(self.log_counter) % self.log_every == 0
+    if log:
+      start_time = time.time()
+      REQUEST_LOG.debug("request id=%d %s", request.id,
+                        Summarise(request, self.log_payload_size))
+
+    # Create a response and fill its ID
+    response = self.message_class()
+    response.id = request.id
+
+    try:
+      # Find a function to handle the request and call it
+      function, request_pb, response_pb = \
+          self.FunctionForRequest(request, response)
+      function(request_pb, response_pb)
+    except Exception, ex:
+      REQUEST_LOG.exception("Error handling request id=%d %s", request.id,
+                            Summarise(request, self.log_payload_size))
+      response.error_response.message = \
+        "%s: %s" % (ex.__class__.__name__, str(ex))
+
+    if log:
+      REQUEST_LOG.debug("response id=%d time_ms=%.1f %s", response.id,
+                        (time.time() - start_time) * 1000,
+                        Summarise(response, self.log_payload_size))
+
+    return response
+
+  def SendResponse(self, response):
+    """
+    Queues a response for the writer thread, which sends responses in the
+    order they were finished.  Safe to call from any thread.
+    """
 
-    input_handle = output_handle = sock.makefile()
+    self.response_queue.put(response)
 
-    while True:
+  def SendNotification(self, message):
+    """
+    Writes a message that isn't a response to any request.  Its ID is 0, which
+    is never used by requests.  Safe to call from any thread.
+    """
+
+    message.id = 0
+    self.SendResponse(message)
+
+  def IsBackgroundRequest(self, request):
+    """
+    Returns True if the request should be handled on the background thread.
+    """
+
+    return any(request.HasField(x) for x in self.BACKGROUND_REQUESTS)
+
+  def IsImmediateRequest(self, request):
+    """
+    Returns True if the request should be handled on the reader thread.
+    """
+
+    return any(request.HasField(x) for x in self.IMMEDIATE_REQUESTS)
+
+  def CancelRequest(self, request, response):
+    """
+    Stops the request with the given ID from being handled, if it's still
+    waiting in a queue.  It gets an error response instead.
+    """
+
+    with self.queue_lock:
+      if request.request_id in self.queued_ids:
+        self.cancelled_ids.add(request.request_id)
+        response.cancelled = True
+
+  def AfterFork(self):
+    """
+    Called in a forked child before it handles its request.  Only the thread
+    that forked exists in the child, so subclasses should replace any locks
+    and database connections the other threads might have been using.
+    """
+
+    self.AfterPoolFork()
+    self.queue_lock = threading.Lock()
+
+  def AfterPoolFork(self):
+    """
+    Called first thing in a process forked to do work other than handling a
+    request, like parsing files for an index.  Replaces the logging locks and
+    closes the inherited socket, so the plugin sees the worker exit even if
+    the process outlives it.
+    """
+
+    # pylint: disable=W0212
+    logging._lock = threading.RLock()
+    for ref in logging._handlerList:
+      handler = ref()
+      if handler is not None:
+        handler.createLock()
+
+    # The parent's file objects share the socket, so point its descriptor at
+    # /dev/null rather than closing it, so the number isn't reused.
+    if self.socket is not None:
+      devnull = os.open(os.devnull, os.O_RDWR)
+      os.dup2(devnull, self.socket.fileno())
+      os.close(devnull)
+
+  def CanFork(self):
+    """
+    Returns False if another thread might be holding a lock that a forked
+    child can't replace, like SQLite's.  Subclasses that start threads of
+    their own should check those too.
+    """
+
+    return threading.current_thread() is self.background_thread or \
+           not self.background_busy
+
+  def ForkRequest(self, request):
+    """
+    Handles the request in a forked child, if there's a free slot for one and
+    no other thread is busy.  The child writes its response to a pipe, and a
+    thread in the parent sends it on and waits for the child to exit.
+    Returns False if the request wasn't forked.
+    """
+
+    if self.max_children <= 0 or \
+       not any(request.HasField(x) for x in self.FORKED_REQUESTS):
+      return False
+
+    if not self.background_lock.acquire(False):
+      return False
+    try:
+      if not self.CanFork() or not self.child_slots.acquire(False):
+        return False
+      return self._Fork(request)
+    finally:
+      self.background_lock.release()
+
+  def _Fork(self, request):
+    read_fd, write_fd = os.pipe()
+    try:
+      pid = os.fork()
+    except OSError:
+      logging.exception("Failed to fork, handling request in the parent")
+      os.close(read_fd)
+      os.close(write_fd)
+      self.child_slots.release()
+      return False
+
+    if pid == 0:
+      # The child never returns from here
       try:
-        request = self.ReadMessage(input_handle)
-      except ShortReadError:
-        break
+        os.close(read_fd)
+        self.AfterFork()
+        with os.fdopen(write_fd, "wb") as handle:
+          self.WriteMessage(handle, self.HandleRequest(request))
+      except BaseException:
+        logging.exception("Error in forked child")
+      finally:
+        os._exit(0)  # pylint: disable=W0212
+
+    os.close(write_fd)
+
+    thread = threading.Thread(target=self._ForwardChildResponse,
+                              args=(pid, read_fd, request.id),
+                              name="ForkedRequest-%d" % pid)
+    thread.daemon = True
+    thread.start()
+    return True
+
+  def _ForwardChildResponse(self, pid, read_fd, request_id):
+    """
+    Sends the response a forked child wrote to its pipe.  A child that hasn't
+    finished after CHILD_TIMEOUT seconds is killed and an error is sent
+    instead.
+    """
 
-      print >> sys.stderr, ">" * 80
-      print >> sys.stderr, request
+    try:
+      error = None
+      data = []
+      deadline = time.time() + self.CHILD_TIMEOUT
+
+      # The child closes the pipe when it exits.
+      while True:
+        timeout = deadline - time.time()
+        if timeout <= 0 or not select.select([read_fd], [], [], timeout)[0]:
+          error = "Forked child %d timed out" % pid
+          try:
+            os.kill(pid, signal.SIGKILL)
+          except OSError:
+            pass
+          break
+
+        chunk = os.read(read_fd, 65536)
+        if not chunk:
+          break
+        data.append(chunk)
+
+      if error is None:
+        try:
+          response = self.ReadMessage(cStringIO.StringIO("".join(data)))
+        except ShortReadError:
+          error = "Forked child %d exited without a response" % pid
+
+      if error is not None:
+        response = self.message_class()
+        response.id = request_id
+        response.error_response.message = error
+
+      self.SendResponse(response)
+    finally:
+      os.close(read_fd)
+      os.waitpid(pid, 0)
+      self.child_slots.release()
+
+  def _NextRequest(self, queue):
+    """
+    Returns the next request from the queue that wasn't cancelled, sending
+    error responses for the ones that were.  Returns None once the reader
+    thread has stopped.
+    """
+
+    while True:
+      request = queue.get()
+      if request is None:
+        return None
+
+      with self.queue_lock:
+        self.queued_ids.discard(request.id)
+        if request.id not in self.cancelled_ids:
+          return request
+        self.cancelled_ids.discard(request.id)
 
-      # Create a response and fill its ID
       response = self.message_class()
       response.id = request.id
+      response.error_response.message = "Cancelled"
+      self.SendResponse(response)
 
-      try:
-        # Find a function to handle the request and call it
-        function, request_pb, response_pb = \
-            self.FunctionForRequest(request, response)
-        function(request_pb, response_pb)
-      except Exception, ex:
-        logging.exception("Error handling request %s", request)
-        response.error_response.message = \
-          "%s: %s" % (ex.__class__.__name__, str(ex))
-
-      print >> sys.stderr, "<" * 80
-      print >> sys.stderr, response
+  def _ReadLoop(self, input_handle):
+    """
+    Reads requests and queues them for the main or background thread until the
+    socket is closed.  Immediate requests are handled straight away.
+    """
+
+    try:
+      while True:
+        try:
+          request = self.ReadMessage(input_handle)
+        except ShortReadError:
+          break
+
+        if self.IsImmediateRequest(request):
+          self.SendResponse(self.HandleRequest(request))
+          continue
+
+        with self.queue_lock:
+          self.queued_ids.add(request.id)
+
+        if self.IsBackgroundRequest(request):
+          self.background_queue.put(request)
+        else:
+          self.request_queue.put(request)
+    finally:
+      self.request_queue.put(None)
+      self.background_queue.put(None)
+
+  def _WriteLoop(self, output_handle):
+    """
+    Writes responses from the response queue until it gets None.
+    """
+
+    while True:
+      response = self.response_queue.get()
+      if response is None:
+        break
 
       self.WriteMessage(output_handle, response)
+
+  def _BackgroundLoop(self):
+    """
+    Handles requests from the background queue until the reader stops.
+    """
+
+    while True:
+      request = self._NextRequest(self.background_queue)
+      if request is None:
+        break
+
+      with self.background_lock:
+        self.background_busy = True
+        try:
+          response = self.HandleRequest(request)
+        finally:
+          self.background_busy = False
+      self.SendResponse(response)
+
+  def _StartThread(self, target, name, *args):
+    thread = threading.Thread(target=target, args=args, name=name)
+    thread.daemon = True
+    thread.start()
+    return thread
+
+  def ServeForever(self, socket_filename):
+    """
+    Connects to the given local socket and listens for incoming request
+    protobufs.  Requests are read on one thread and responses written on
+    another, so a response is sent as soon as its request is finished and
+    requests can be cancelled while another one is running.  Requests are
+    handled one at a time on this thread, except for background, forked and
+    immediate ones.
+    """
+
+    sock = self.socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(socket_filename)
+
+    # Separate file objects for the reader and writer threads
+    input_handle = sock.makefile("rb")
+    output_handle = sock.makefile("wb")
+
+    writer_thread = self._StartThread(
+        self._WriteLoop, "ResponseWriter", output_handle)
+    self._StartThread(self._ReadLoop, "RequestReader", input_handle)
+    self.background_thread = self._StartThread(
+        self._BackgroundLoop, "BackgroundRequests")
+
+    while True:
+      request = self._NextRequest(self.request_queue)
+      if request is None:
+        break
+
+      if not self.ForkRequest(request):
+        self.SendResponse(self.HandleRequest(request))
+
+    # Send the responses that are already finished before exiting
+    self.response_queue.put(None)
+    writer_thread.join()
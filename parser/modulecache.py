@@ -0,0 +1,137 @@
+"""
+Keeps the modules rope parsed from unsaved buffers, so asking about the same
+buffer again doesn't parse it again.
+"""
+
+import collections
+import hashlib
+
+from rope.base import utils
+from rope.contrib import fixsyntax
+
+import syntaxfixer
+
+# rope's own FixSyntax, before Install replaces it.
+RopeFixSyntax = fixsyntax.FixSyntax
+
+
+class ModuleCache(object):
+  """
+  A bounded LRU of the PyModules built by rope's FixSyntax, keyed by the
+  project, the resource, a hash of the source and the number of syntax errors
+  rope was allowed to fix.  A completion followed by a tooltip on the same
+  buffer only parses it once.
+
+  Modules hold on to the modules they import, so all of a project's modules
+  are forgotten whenever rope invalidates any of its resources.
+
+  Code with syntax errors is fixed by a SyntaxFixer, which is given the lines
+  that had errors in the previous version of the same buffer.
+  """
+
+  DEFAULT_SIZE = 16
+
+  def __init__(self, size=DEFAULT_SIZE):
+    self.size = size
+    self.modules = collections.OrderedDict()
+    self.watched = set()
+    self.error_lines = {}
+
+  def Install(self):
+    """
+    Makes every FixSyntax created from now on use this cache, including the
+    ones rope's codeassist module creates itself.
+    """
+
+    cache = self
+
+    class CachingFixSyntax(RopeFixSyntax):
+      """
+      A FixSyntax that looks in the cache before parsing the code.
+      """
+
+      def get_pymodule(self):
+        return cache.GetPyModule(self)
+
+      @property
+      @utils.saveit
+      def commenter(self):
+        return syntaxfixer.Commenter(self.code)
+
+    fixsyntax.FixSyntax = CachingFixSyntax
+
+  def Watch(self, pycore):
+    """
+    Forgets the modules of pycore's project when rope invalidates any of its
+    resources.
+    """
+
+    address = pycore.project.address
+    if address not in self.watched:
+      self.watched.add(address)
+      pycore.cache_observers.append(lambda _resource: self.Forget(address))
+
+  def Forget(self, address):
+    """
+    Forgets all the modules of the project at address.
+    """
+
+    for key in [x for x in self.modules if x[0] == address]:
+      del self.modules[key]
+
+  def Unwatch(self, pycore):
+    """
+    Forgets the modules of pycore's project when it is closed.
+    """
+
+    address = pycore.project.address
+    self.watched.discard(address)
+    self.Forget(address)
+
+    for key in [x for x in self.error_lines if x[0] == address]:
+      del self.error_lines[key]
+
+  def GetPyModule(self, fixer):
+    """
+    Returns the PyModule for the FixSyntax fixer, parsing its code only if
+    it's not in the cache.
+    """
+
+    # Already done for this fixer
+    if hasattr(fixer, "_get_pymodule"):
+      return fixer._get_pymodule  # pylint: disable=W0212
+
+    code = fixer.code
+    if isinstance(code, unicode):
+      code = code.encode("utf-8")
+
+    buffer_key = (
+      fixer.pycore.project.address,
+      fixer.resource.path if fixer.resource is not None else None,
+    )
+    key = buffer_key + (hashlib.sha1(code).hexdigest(), fixer.maxfixes)
+
+    try:
+      pymodule, commenter = self.modules.pop(key)
+    except KeyError:
+      syntax_fixer = syntaxfixer.SyntaxFixer(fixer)
+      try:
+        pymodule = syntax_fixer.GetPyModule(
+            self.error_lines.get(buffer_key, ()))
+      finally:
+        self.error_lines[buffer_key] = syntax_fixer.error_lines
+
+      # The commenter maps offsets in the code to offsets in the fixed code.
+      # It only exists if there was something to fix.
+      commenter = fixer.__dict__.get("_commenter")
+    else:
+      # pylint: disable=W0201,W0212
+      fixer._get_pymodule = pymodule
+      if commenter is not None:
+        fixer._commenter = commenter
+
+    self.modules[key] = (pymodule, commenter)
+    while len(self.modules) > self.size:
+      self.modules.popitem(last=False)
+
+    return pymodule
@@ -0,0 +1,265 @@
+"""
+Stores rope's object database in SQLite, one record per file.
+"""
+
+import cPickle as pickle
+import os
+import os.path
+import sqlite3
+
+from rope.base.oi import memorydb, objectdb
+
+# rope's own MemoryDB, before Install replaces it.
+RopeMemoryDB = memorydb.MemoryDB
+
+
+class SqliteDB(objectdb.FileDict):
+  """
+  A replacement for rope's MemoryDB.  MemoryDB loads the whole object database
+  from one pickle when the project is opened and writes all of it again every
+  time the project is written, which takes seconds on large projects.
+
+  This keeps each file's scopes in its own row instead.  Only the list of files
+  is read up front, each file's scopes are read the first time they're used,
+  and writes only touch the files that changed since the last write.
+  An existing objectdb pickle is moved into the database the first time.
+
+  Only projects opened with save_objectdb use it, and the worker opens its
+  other projects of the same directory without, but other workers might have
+  the same database open.  It's in WAL mode and waits for their writes.
+  """
+
+  DATABASE_FILENAME = "objectdb.sqlite"
+
+  # Seconds to wait for another connection's write to finish.
+  BUSY_TIMEOUT = 30
+
+  SCHEMA = """
+    CREATE TABLE IF NOT EXISTS files (
+      path TEXT PRIMARY KEY,
+      scopes BLOB NOT NULL
+    );
+  """
+
+  @classmethod
+  def Install(cls):
+    """
+    Makes every rope project opened from now on that saves its object database
+    use this class instead of MemoryDB.
+    """
+
+    def Create(project, persist=None):
+      if persist is None:
+        persist = project.prefs.get("save_objectdb", False)
+
+      if persist and project.ropefolder is not None:
+        return cls(project)
+      return RopeMemoryDB(project, persist=persist)
+
+    memorydb.MemoryDB = Create
+
+  def __init__(self, project):
+    self.project = project
+    self.files = self
+
+    # rope creates its folder after the object database, when a project is
+    # opened for the first time.
+    folder = project.ropefolder.real_path
+    if not os.path.isdir(folder):
+      os.makedirs(folder)
+
+    self.filename = os.path.join(folder, self.DATABASE_FILENAME)
+    self.conn = self._Connect()
+    self.conn.executescript(self.SCHEMA)
+    self.inherited_connections = []
+
+    if self.conn.execute("SELECT 1 FROM files LIMIT 1").fetchone() is None:
+      self._ImportPickle()
+
+    self._paths = set(x for (x,) in self.conn.execute("SELECT path FROM files"))
+    self._loaded = {}
+    self._dirty = set()
+    self._removed = set()
+
+    self.project.data_files.add_write_hook(self.write)
+
+  def _Connect(self):
+    conn = sqlite3.connect(self.filename, timeout=self.BUSY_TIMEOUT,
+                           check_same_thread=False)
+    conn.text_factory = str
+    conn.execute("PRAGMA journal_mode = WAL")
+    return conn
+
+  def AfterFork(self):
+    """
+    Opens a new connection in a forked child.  The parent's is kept but never
+    used or closed.
+    """
+
+    self.inherited_connections.append(self.conn)
+    self.conn = self._Connect()
+
+  def _ImportPickle(self):
+    """
+    Moves the scopes out of the pickle MemoryDB wrote, if there is one.
+    """
+
+    compress = self.project.prefs.get("compress_objectdb", False)
+    result = self.project.data_files.read_data(
+        "objectdb", compress=compress, import_=True)
+    if not isinstance(result, dict):
+      return
+
+    rows = []
+    for path, scopes in result.iteritems():
+      info = FileInfo(self, path, dict(
+          (key, ScopeInfo(self, path, scope.call_info, scope.per_name))
+          for key, scope in scopes.iteritems()))
+      rows.append((path, sqlite3.Binary(info.Serialize())))
+
+    # Another worker opening the same project might be importing it too, so
+    # check the table is still empty with the write lock held.
+    self.conn.isolation_level = None
+    try:
+      self.conn.execute("BEGIN IMMEDIATE")
+      try:
+        if self.conn.execute("SELECT 1 FROM files LIMIT 1").fetchone() is None:
+          self.conn.executemany(
+              "INSERT INTO files (path, scopes) VALUES (?, ?)", rows)
+      except:
+        self.conn.execute("ROLLBACK")
+        raise
+      self.conn.execute("COMMIT")
+    finally:
+      self.conn.isolation_level = ""
+
+    for name in ("objectdb", "objectdb.gz"):
+      try:
+        os.remove(os.path.join(self.project.ropefolder.real_path, name))
+      except OSError:
+        pass
+
+  def MarkDirty(self, path):
+    """
+    Remembers that path's scopes have to be written next time.
+    """
+
+    # Scopes of a file that has since been removed or renamed don't count
+    if path in self._loaded:
+      self._dirty.add(path)
+
+  def keys(self):
+    return list(self._paths)
+
+  def __contains__(self, key):
+    return key in self._paths
+
+  def __getitem__(self, key):
+    if key not in self._paths:
+      raise KeyError(key)
+
+    try:
+      return self._loaded[key]
+    except KeyError:
+      pass
+
+    row = self.conn.execute(
+        "SELECT scopes FROM files WHERE path = ?", (key, )).fetchone()
+
+    scopes = {}
+    if row is not None:
+      for scope_key, (call_info, per_name) in \
+          pickle.loads(str(row[0])).iteritems():
+        scopes[scope_key] = ScopeInfo(self, key, call_info, per_name)
+
+    info = self._loaded[key] = FileInfo(self, key, scopes)
+    return info
+
+  def create(self, path):
+    self._paths.add(path)
+    self._loaded[path] = FileInfo(self, path, {})
+    self._removed.discard(path)
+    self._dirty.add(path)
+
+  def rename(self, file, newfile):
+    if file not in self._paths:
+      return
+
+    info = self[file]
+    self.create(newfile)
+    for key, scope in info.scopes.iteritems():
+      self._loaded[newfile].scopes[key] = \
+          ScopeInfo(self, newfile, scope.call_info, scope.per_name)
+    del self[file]
+
+  def __delitem__(self, file):
+    self._paths.remove(file)
+    self._loaded.pop(file, None)
+    self._dirty.discard(file)
+    self._removed.add(file)
+
+  def write(self):
+    if not self._dirty and not self._removed:
+      return
+
+    with self.conn:
+      self.conn.executemany("DELETE FROM files WHERE path = ?",
+                            ((x, ) for x in self._removed))
+      self.conn.executemany(
+          "INSERT OR REPLACE INTO files (path, scopes) VALUES (?, ?)",
+          ((x, sqlite3.Binary(self._loaded[x].Serialize()))
+           for x in self._dirty))
+
+    self._dirty.clear()
+    self._removed.clear()
+
+
+class FileInfo(memorydb.FileInfo):
+  """
+  The scopes of one file, which marks the file dirty when they change.
+  """
+
+  def __init__(self, db, path, scopes):
+    memorydb.FileInfo.__init__(self, scopes)
+    self.db = db
+    self.path = path
+
+  def create_scope(self, key):
+    self.scopes[key] = ScopeInfo(self.db, self.path, {}, {})
+    self.db.MarkDirty(self.path)
+
+  def __delitem__(self, key):
+    del self.scopes[key]
+    self.db.MarkDirty(self.path)
+
+  def Serialize(self):
+    """
+    Returns the scopes pickled without any rope classes in them.
+    """
+
+    return pickle.dumps(
+        dict((key, (scope.call_info, scope.per_name))
+             for key, scope in self.scopes.iteritems()),
+        pickle.HIGHEST_PROTOCOL)
+
+
+class ScopeInfo(memorydb.ScopeInfo):
+  """
+  The call and name information of one scope, which marks its file dirty when
+  it changes.
+  """
+
+  def __init__(self, db, path, call_info, per_name):
+    memorydb.ScopeInfo.__init__(self)
+    self.db = db
+    self.path = path
+    self.call_info = call_info
+    self.per_name = per_name
+
+  def save_per_name(self, name, value):
+    memorydb.ScopeInfo.save_per_name(self, name, value)
+    self.db.MarkDirty(self.path)
+
+  def add_call(self, parameters, returned):
+    memorydb.ScopeInfo.add_call(self, parameters, returned)
+    self.db.MarkDirty(self.path)
@@ -0,0 +1,524 @@
+"""
+Precomputed summaries of the standard library's modules, so rope doesn't have
+to parse a standard library module just to list its attributes or show a
+docstring or a signature.
+
+Run this file with the python the worker will use to build the summaries:
+
+  python stdlibsummary.py stdlib_summaries.bin
+"""
+
+import ast
+import cPickle as pickle
+import os
+import os.path
+import pkgutil
+import sys
+import weakref
+import zlib
+
+from distutils import sysconfig
+
+import rope.base.pycore
+from rope.base import exceptions, pynames, pyobjects
+
+
+SUMMARIES_FILENAME = "stdlib_summaries.bin"
+
+# Directories in the standard library that aren't summarised.
+IGNORED_DIRECTORIES = frozenset([
+  "site-packages", "dist-packages", "test", "tests",
+])
+
+# Kinds of summary entries.  Each entry is a tuple starting with its kind and
+# the line it's defined on.
+FUNCTION = 0   # (FUNCTION, line, docstring, parameters)
+CLASS    = 1   # (CLASS, line, docstring)
+MODULE   = 2   # (MODULE, line, module name, level)
+IMPORT   = 3   # (IMPORT, line, module name, level, name in module)
+VARIABLE = 4   # (VARIABLE, line)
+
+
+def StandardLibraryDirectory():
+  """
+  Returns the standard library directory of the running interpreter.
+  """
+
+  return os.path.realpath(sysconfig.get_python_lib(standard_lib=True))
+
+
+class _Summariser(object):
+  """
+  Builds the summary of one module from its source without importing it.
+  Names defined in both branches of an if or a try keep their first
+  definition, which is usually the one for the common platform.
+  """
+
+  def __init__(self):
+    self.names = {}
+    self.star_imports = []
+
+  def Summarise(self, tree):
+    """
+    Returns (docstring, names, star imports) for the module's ast.
+    """
+
+    self._VisitBody(tree.body, False)
+    return (ast.get_docstring(tree, clean=False), self.names,
+            self.star_imports)
+
+  def _Define(self, name, entry, conditional):
+    if conditional and name in self.names:
+      return
+    self.names[name] = entry
+
+  def _VisitBody(self, body, conditional):
+    for node in body:
+      self._Visit(node, conditional)
+
+  def _Visit(self, node, conditional):
+    if isinstance(node, ast.FunctionDef):
+      self._Define(node.name, (FUNCTION, node.lineno,
+          ast.get_docstring(node, clean=False), self._Parameters(node.args)),
+          conditional)
+    elif isinstance(node, ast.ClassDef):
+      self._Define(node.name, (CLASS, node.lineno,
+          ast.get_docstring(node, clean=False)), conditional)
+    elif isinstance(node, ast.Import):
+      for alias in node.names:
+        if alias.asname:
+          self._Define(alias.asname,
+              (MODULE, node.lineno, alias.name, 0), conditional)
+        else:
+          # "import a.b" binds a
+          name = alias.name.split(".")[0]
+          self._Define(name, (MODULE, node.lineno, name, 0), conditional)
+    elif isinstance(node, ast.ImportFrom):
+      module = node.module or ""
+      for alias in node.names:
+        if alias.name == "*":
+          self.star_imports.append((module, node.level))
+        else:
+          self._Define(alias.asname or alias.name,
+              (IMPORT, node.lineno, module, node.level, alias.name),
+              conditional)
+    elif isinstance(node, (ast.Assign, ast.AugAssign)):
+      targets = node.targets if isinstance(node, ast.Assign) else [node.target]
+      for target in targets:
+        for name in self._AssignedNames(target):
+          self._Define(name, (VARIABLE, node.lineno), conditional)
+    elif isinstance(node, ast.If):
+      self._VisitBody(node.body, True)
+      self._VisitBody(node.orelse, True)
+    elif isinstance(node, ast.TryExcept):
+      self._VisitBody(node.body, True)
+      for handler in node.handlers:
+        self._VisitBody(handler.body, True)
+      self._VisitBody(node.orelse, True)
+    elif isinstance(node, ast.TryFinally):
+      self._VisitBody(node.body, conditional)
+      self._VisitBody(node.finalbody, conditional)
+
+  def _AssignedNames(self, target):
+    if isinstance(target, ast.Name):
+      return [target.id]
+    if isinstance(target, (ast.Tuple, ast.List)):
+      return [x for element in target.elts for x in self._AssignedNames(element)]
+    return []
+
+  @staticmethod
+  def _Default(node):
+    if isinstance(node, ast.Num):
+      return repr(node.n)
+    if isinstance(node, ast.Str):
+      return repr(node.s)
+    if isinstance(node, ast.Name):
+      return node.id
+    if isinstance(node, ast.Attribute):
+      value = _Summariser._Default(node.value)
+      if value != "...":
+        return "%s.%s" % (value, node.attr)
+    return "..."
+
+  def _Parameters(self, args):
+    """
+    Returns the function's parameters as they'd be written in its definition.
+    """
+
+    ret = []
+    first_default = len(args.args) - len(args.defaults)
+    for i, arg in enumerate(args.args):
+      # Tuple parameters don't have a name
+      name = arg.id if isinstance(arg, ast.Name) else "..."
+      if i >= first_default:
+        name = "%s=%s" % (name, self._Default(args.defaults[i - first_default]))
+      ret.append(name)
+
+    if args.vararg:
+      ret.append("*" + args.vararg)
+    if args.kwarg:
+      ret.append("**" + args.kwarg)
+    return ret
+
+
+def _StandardLibraryModules(root):
+  """
+  Yields (module name, relative path of the module's file, is package) for
+  every module in the standard library directory.
+  """
+
+  for dirpath, dirnames, filenames in os.walk(root):
+    relative_dir = os.path.relpath(dirpath, root)
+    if relative_dir == ".":
+      package = []
+    else:
+      package = relative_dir.split(os.sep)
+
+    # Only descend into packages
+    dirnames[:] = [
+      x for x in dirnames
+      if x not in IGNORED_DIRECTORIES and
+         os.path.exists(os.path.join(dirpath, x, "__init__.py"))]
+
+    for filename in filenames:
+      if not filename.endswith(".py"):
+        continue
+
+      relative_path = os.path.normpath(os.path.join(relative_dir, filename))
+      if filename == "__init__.py":
+        if package:
+          yield (".".join(package), relative_path, True)
+      else:
+        yield (".".join(package + [filename[:-3]]), relative_path, False)
+
+
+def BuildSummaries():
+  """
+  Summarises every module in the standard library.  Returns a dict that
+  SerializeSummaries can write out.
+  """
+
+  root = StandardLibraryDirectory()
+  modules = {}
+
+  for module_name, relative_path, is_package in _StandardLibraryModules(root):
+    filename = os.path.join(root, relative_path)
+    with open(filename) as handle:
+      source = handle.read()
+
+    try:
+      tree = compile(source, filename, "exec", ast.PyCF_ONLY_AST)
+    except (SyntaxError, TypeError):
+      continue
+
+    doc, names, star_imports = _Summariser().Summarise(tree)
+
+    if is_package:
+      # A package's submodules are attributes too, unless __init__ defines
+      # something with the same name.
+      package_dir = os.path.dirname(filename)
+      for child in os.listdir(package_dir):
+        child_path = os.path.join(package_dir, child)
+        if child.endswith(".py") and child != "__init__.py":
+          child = child[:-3]
+        elif not os.path.exists(os.path.join(child_path, "__init__.py")):
+          continue
+        names.setdefault(child, (MODULE, 1, "%s.%s" % (module_name, child), 0))
+
+    modules[module_name] = zlib.compress(pickle.dumps(
+        (relative_path, len(source), doc, names, star_imports),
+        pickle.HIGHEST_PROTOCOL))
+
+  return {"version": sys.version, "modules": modules}
+
+
+def SerializeSummaries(summaries):
+  return pickle.dumps(summaries, pickle.HIGHEST_PROTOCOL)
+
+
+class StdlibSummaries(object):
+  """
+  Answers rope's requests for standard library modules from the summaries
+  built with this file, instead of parsing the modules.  A summary is only
+  used if it was built by the same version of python and the module's file
+  hasn't changed size.  Anything a summary doesn't know, like what a function
+  returns or the attributes of a class, is looked up in the parsed module the
+  first time it's needed.
+  """
+
+  def __init__(self, data=None):
+    self.data = data
+    self.modules = None
+    self.root = StandardLibraryDirectory()
+
+    # Summary modules by name for each pycore
+    self.pycores = weakref.WeakKeyDictionary()
+
+  def _Modules(self):
+    """
+    Returns the serialized summaries by module name, loading them the first
+    time.
+    """
+
+    if self.modules is None:
+      self.modules = {}
+
+      data = self.data
+      if data is None:
+        try:
+          data = pkgutil.get_data(__name__, SUMMARIES_FILENAME)
+        except IOError:
+          pass
+
+      if data is not None:
+        summaries = pickle.loads(data)
+        if summaries["version"] == sys.version:
+          self.modules = summaries["modules"]
+
+    return self.modules
+
+  def Install(self):
+    """
+    Makes rope look in these summaries before it parses a standard library
+    module.
+    """
+
+    summaries = self
+    rope_get_module = rope.base.pycore.PyCore.get_module
+
+    def GetModule(pycore, name, folder=None):
+      module = summaries.GetModule(pycore, name, folder)
+      if module is None:
+        module = rope_get_module(pycore, name, folder)
+      return module
+
+    rope.base.pycore.PyCore.get_module = GetModule
+
+  def GetModule(self, pycore, name, folder=None):
+    """
+    Returns a SummaryModule for the module called name, or None if rope
+    should parse it itself.
+    """
+
+    modules = self.pycores.setdefault(pycore, {})
+    if name in modules:
+      return modules[name]
+
+    module = None
+    serialized = self._Modules().get(name)
+    if serialized is not None:
+      module = self._CreateModule(pycore, name, folder, serialized)
+
+    modules[name] = module
+    return module
+
+  def _CreateModule(self, pycore, name, folder, serialized):
+    relative_path, size, doc, names, star_imports = \
+        pickle.loads(zlib.decompress(serialized))
+
+    # Is this the module rope would have found?  The project could have one
+    # with the same name.
+    resource = pycore.find_module(name, folder)
+    if resource is None:
+      return None
+
+    filename = os.path.join(self.root, relative_path)
+    if resource.is_folder():
+      if os.path.join(resource.real_path, "__init__.py") != filename:
+        return None
+    elif resource.real_path != filename:
+      return None
+
+    try:
+      if os.path.getsize(filename) != size:
+        return None
+    except OSError:
+      return None
+
+    return SummaryModule(pycore, resource, doc, names, star_imports)
+
+
+class SummaryModule(pyobjects.AbstractModule):
+  """
+  A module whose attributes come from its summary.
+  """
+
+  def __init__(self, pycore, resource, doc, names, star_imports):
+    super(SummaryModule, self).__init__()
+    self.pycore = pycore
+    self.resource = resource
+    self.doc = doc
+    self.names = names
+    self.star_imports = star_imports
+
+    self.parent = None
+    self.attributes = None
+    self.real_module = None
+
+  def get_doc(self):
+    return self.doc
+
+  def get_resource(self):
+    return self.resource
+
+  def get_module(self):
+    return self
+
+  def get_name(self):
+    return self.pycore.modname(self.resource)
+
+  def _get_concluded_data(self):
+    # Summaries never change, so nothing has to be forgotten
+    return pyobjects._ConcludedData()  # pylint: disable=W0212
+
+  def get_attributes(self):
+    if self.attributes is None:
+      self.attributes = {}
+
+      for module_name, level in self.star_imports:
+        imported = pynames.ImportedModule(self, module_name, level).get_object()
+        for name, pyname in imported.get_attributes().iteritems():
+          if not name.startswith("_"):
+            self.attributes[name] = pyname
+
+      for name, entry in self.names.iteritems():
+        self.attributes[name] = self._PyName(name, entry)
+
+    return self.attributes
+
+  def _PyName(self, name, entry):
+    kind, line = entry[:2]
+
+    if kind == FUNCTION:
+      return SummaryName(SummaryFunction(self, name, entry[2], entry[3]),
+                         self, line)
+    if kind == CLASS:
+      return SummaryName(SummaryClass(self, name, entry[2]), self, line)
+    if kind == MODULE:
+      return pynames.ImportedModule(self, entry[2], entry[3])
+    if kind == IMPORT:
+      return pynames.ImportedName(
+          pynames.ImportedModule(self, entry[2], entry[3]), entry[4])
+    return SummaryName(SummaryValue(self, name), self, line)
+
+  def RealAttribute(self, name):
+    """
+    Returns the object called name in the parsed module, parsing it the first
+    time.
+    """
+
+    if self.real_module is None:
+      self.real_module = self.pycore.resource_to_pyobject(self.resource)
+
+    try:
+      return self.real_module[name].get_object()
+    except exceptions.AttributeNotFoundError:
+      return pyobjects.get_unknown()
+
+
+class SummaryName(pynames.DefinedName):
+  """
+  A name defined in a summary module.
+  """
+
+  def __init__(self, pyobject, module, line):
+    super(SummaryName, self).__init__(pyobject)
+    self.module = module
+    self.line = line
+
+  def get_definition_location(self):
+    return (self.module, self.line)
+
+
+class SummaryFunction(pyobjects.AbstractFunction):
+  """
+  A function in a summary module.  Knows its signature and docstring.
+  """
+
+  def __init__(self, module, name, doc, parameters):
+    super(SummaryFunction, self).__init__()
+    self.parent = module
+    self.name = name
+    self.doc = doc
+    self.parameters = parameters
+
+  def get_name(self):
+    return self.name
+
+  def get_doc(self):
+    return self.doc
+
+  def get_module(self):
+    return self.parent
+
+  def get_param_names(self, special_args=True):
+    ret = []
+    for parameter in self.parameters:
+      if parameter.startswith("*"):
+        if special_args:
+          ret.append(parameter.lstrip("*"))
+      else:
+        ret.append(parameter.split("=", 1)[0])
+    return ret
+
+  def get_returned_object(self, args):
+    return self.parent.RealAttribute(self.name).get_returned_object(args)
+
+
+class SummaryClass(pyobjects.AbstractClass):
+  """
+  A class in a summary module.  Knows its docstring, but its attributes and
+  base classes come from the parsed module.
+  """
+
+  def __init__(self, module, name, doc):
+    super(SummaryClass, self).__init__()
+    self.parent = module
+    self.name = name
+    self.doc = doc
+
+  def get_name(self):
+    return self.name
+
+  def get_doc(self):
+    return self.doc
+
+  def get_module(self):
+    return self.parent
+
+  def get_attributes(self):
+    return self.parent.RealAttribute(self.name).get_attributes()
+
+  def get_superclasses(self):
+    return self.parent.RealAttribute(self.name).get_superclasses()
+
+
+class SummaryValue(pyobjects.PyObject):
+  """
+  A variable in a summary module.  Its type comes from the parsed module.
+  """
+
+  def __init__(self, module, name):
+    super(SummaryValue, self).__init__(None)
+    self.parent = module
+    self.name = name
+
+  def get_type(self):
+    return self.parent.RealAttribute(self.name).get_type()
+
+  def get_attributes(self):
+    return self.parent.RealAttribute(self.name).get_attributes()
+
+
+def Main(args):
+  """
+  Writes the summaries of the running interpreter's standard library to the
+  file given on the commandline.
+  """
+
+  with open(args[0], "wb") as handle:
+    handle.write(SerializeSummaries(BuildSummaries()))
+
+
+if __name__ == "__main__":
+  Main(sys.argv[1:])
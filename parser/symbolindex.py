@@ -2,26 +2,238 @@
 Builds, maintains and searches an index of symbols in the project.
 """
 
+import collections
+import hashlib
+import heapq
+import itertools
+import logging
+import multiprocessing
+import os
 import os.path
 import re
 import sqlite3
+import struct
 
 import rope.base.exceptions
+import rope.base.project
 import rope.base.pynames
 import rope.base.pyobjects
 
 import rpc_pb2
 
 
+# The rope project used by each process in the indexing pool.
+_pool_project = None
+
+# (can_fork, after_fork), see SetForkHooks.
+_fork_hooks = (lambda: True, lambda: None)
+
+
+def SetForkHooks(can_fork, after_fork):
+  """
+  Indexes only start a pool of processes when can_fork() returns True, and
+  parse the files themselves otherwise.  after_fork() is called first thing in
+  each pool process.  The worker uses these to fork only when no other thread
+  is using SQLite, and to close what the processes inherit from it.
+  """
+
+  global _fork_hooks # pylint: disable=W0603
+  _fork_hooks = (can_fork, after_fork)
+
+
+def _InitPoolProcess(root, prefs, after_fork):
+  """
+  Opens the project in a new indexing process.  It has no rope folder, so
+  nothing in the main project's is read or written.
+  """
+
+  after_fork()
+
+  global _pool_project # pylint: disable=W0603
+  _pool_project = rope.base.project.Project(root, ropefolder=None, **prefs)
+
+
+def _ParseInPoolProcess(file_path):
+  """
+  Parses one file in an indexing process.
+  """
+
+  return SymbolIndex.ParseFile(_pool_project, _pool_project.get_file(file_path))
+
+
+# Searches build a handful of different statements depending on the shape of
+# the query.  Keep them all prepared.
+SEARCH_CACHED_STATEMENTS = 256
+
+
+def _HasTrigramTokenizer():
+  """
+  Returns True if SQLite was built with FTS5, and is new enough (3.34) to have
+  its trigram tokenizer.
+  """
+
+  if sqlite3.sqlite_version_info < (3, 34, 0):
+    return False
+
+  conn = sqlite3.connect(":memory:")
+  try:
+    conn.execute("CREATE VIRTUAL TABLE t USING fts5(x, tokenize='trigram')")
+  except sqlite3.OperationalError:
+    return False
+  finally:
+    conn.close()
+  return True
+
+
+# Without the trigram index every name is matched with LIKE instead.
+TRIGRAM_INDEX = _HasTrigramTokenizer()
+
+
+def _LikeEscape(term):
+  """
+  Escapes the LIKE wildcards in term, for patterns with ESCAPE '\\'.
+  """
+
+  return re.sub(r"([\\%_])", r"\\\1", term)
+
+
+def _SearchSelect(schema, index, terms, file_path, symbol_type):
+  """
+  Returns (sql, parameters) for a SELECT statement that finds the terms in the
+  index database with the given schema name.
+  """
+
+  tables = [
+    "%s.files AS f" % schema,
+    "%s.symbols AS s" % schema,
+    "%s.names AS n" % schema,
+  ]
+  where_clauses = [
+    "s.fileid = f.rowid",
+    "s.nameid = n.rowid",
+  ]
+  where_parameters = []
+  rank_parameters = []
+
+  # The trigram index can only be used for words of 3 or more characters.
+  # Shorter words are checked against the name directly.
+  match_terms = []
+  if TRIGRAM_INDEX:
+    match_terms = [x for x in terms if len(x) >= 3]
+  if match_terms:
+    tables.append("%s.symbol_index AS i" % schema)
+    where_clauses += [
+      "i.symbol_index MATCH ?",
+      "i.rowid = n.rowid",
+    ]
+    where_parameters.append(
+        " AND ".join('"%s"' % x for x in match_terms))
+
+  for term in terms:
+    if term not in match_terms:
+      where_clauses.append("n.name LIKE ? ESCAPE '\\'")
+      where_parameters.append("%%%s%%" % _LikeEscape(term))
+
+  if file_path is not None:
+    where_clauses.append("f.file_path = ?")
+    where_parameters.append(file_path)
+
+  if symbol_type is not None:
+    where_clauses.append("s.symbol_type = ?")
+    where_parameters.append(symbol_type)
+
+  # Rank names where the first word starts the name, or one of its dotted
+  # parts, above names where it's somewhere in the middle.
+  prefix_match = "0"
+  if terms:
+    prefix_match = "(n.name LIKE ? ESCAPE '\\' OR n.name LIKE ? ESCAPE '\\')"
+    first = _LikeEscape(terms[0])
+    rank_parameters += ["%s%%" % first, "%%.%s%%" % first]
+
+  sql = """
+    SELECT %d,
+           -%s AS prefix_match,
+           length(n.name) AS name_length,
+           f.module_name,
+           f.file_path,
+           s.line_number,
+           n.name,
+           s.symbol_type
+    FROM %s
+    WHERE %s
+  """ % (index, prefix_match, ", ".join(tables), " AND ".join(where_clauses))
+
+  return sql, rank_parameters + where_parameters
+
+
+def _RankedSearch(conn, databases, query, file_path, symbol_type, limit):
+  """
+  Searches the given (schema name, root directory) index databases on conn in
+  one query.  Returns an iterator over (prefix rank, name length, module_name,
+  file_path, line_number, symbol_name, symbol_type) tuples, best first.  File
+  paths are absolute.
+  """
+
+  # Split the query into words, which also removes any special FTS
+  # characters.
+  terms = [x for x in re.split(r'\W+', query.lower()) if x]
+
+  selects = []
+  parameters = []
+  for index, (schema, _) in enumerate(databases):
+    sql, select_parameters = _SearchSelect(
+        schema, index, terms, file_path, symbol_type)
+    selects.append(sql)
+    parameters += select_parameters
+
+  sql = """
+    %s
+    ORDER BY prefix_match, name_length
+    LIMIT ?
+  """ % " UNION ALL ".join(selects)
+
+  cursor = conn.execute(sql, tuple(parameters + [limit]))
+  return ((prefix_match, name_length, module_name,
+           os.path.join(databases[database][1], path),
+           line_number, symbol_name, result_type)
+          for database, prefix_match, name_length, module_name, path,
+              line_number, symbol_name, result_type in cursor)
+
+
 class SymbolIndex(object):
   """
   Creates an index of all the symbols in all the files in the project.
 
-  Note: file paths passed to and returned from this class are all relative to
-  the project's root directory.
+  Note: file paths passed to this class are all relative to the project's
+  root directory.  Search returns absolute paths.
+
+  The database is in WAL mode, and searches use their own read-only
+  connection, so one thread can search while another refreshes the index.
+  Refresh commits in batches to tables of its own, and moves everything into
+  place in one transaction at the end, so searches see the whole refresh at
+  once.
+  Parsing uses its own rope project so it doesn't race with whatever else the
+  worker is doing with the main one.
   """
 
   DATABASE_FILENAME = "symbol_index.db"
+  TABLE_FILENAME = "symbol_table.bin"
+  OVERLAY_FILENAME = "symbol_overlay.bin"
+
+  # ExportOverlay exports the whole table instead once this many files have
+  # changed since the last time.
+  OVERLAY_MAX_FILES = 200
+
+  # Layout of the exported symbol table.  Everything is little-endian.
+  # Offsets in the file, symbol and string records are relative to the start
+  # of the string table.
+  TABLE_MAGIC = "PYQTCSYM"
+  TABLE_VERSION = 1
+  TABLE_HEADER = struct.Struct("<8s10I")
+  TABLE_FILE = struct.Struct("<4I")      # path, path length, module, length
+  TABLE_SYMBOL = struct.Struct("<5I")    # name, name length, file, line, type
+  TABLE_TRIGRAM = struct.Struct("<3I")   # trigram, first posting, count
+  TABLE_POSTING = struct.Struct("<I")    # symbol index
   SCHEMA = [
     """
     CREATE TABLE files (
@@ -34,20 +246,144 @@ class SymbolIndex(object):
       symbol_name TEXT,
       symbol_type INTEGER
     );
-    CREATE VIRTUAL TABLE symbol_index USING fts3();
-
     CREATE TABLE schema_version (version INTEGER);
     INSERT INTO schema_version(version) VALUES (0);
+    """,
+
+    # Drop the FTS3 index, which only found token prefixes.  It's replaced by
+    # TRIGRAM_SCHEMA when SQLite supports it.
+    """
+    DROP TABLE IF EXISTS symbol_index;
+
+    UPDATE schema_version SET version = 1;
+    """,
+
+    # Store each distinct name once and only index those in the FTS table.
+    # Add indexes for the lookups UpdateFile does.
     """
+    CREATE TABLE names (name TEXT UNIQUE);
+    INSERT INTO names (name) SELECT DISTINCT symbol_name FROM symbols;
+
+    CREATE TABLE symbols_v2 (
+      fileid INTEGER,
+      line_number INTEGER,
+      nameid INTEGER,
+      symbol_type INTEGER
+    );
+    INSERT INTO symbols_v2 (rowid, fileid, line_number, nameid, symbol_type)
+      SELECT s.rowid, s.fileid, s.line_number, n.rowid, s.symbol_type
+      FROM symbols AS s, names AS n
+      WHERE n.name = s.symbol_name;
+    DROP TABLE symbols;
+    ALTER TABLE symbols_v2 RENAME TO symbols;
+
+    CREATE INDEX symbols_fileid ON symbols (fileid);
+    CREATE INDEX symbols_nameid ON symbols (nameid);
+    CREATE INDEX files_file_path ON files (file_path);
+
+    DROP TABLE IF EXISTS symbol_index;
+
+    UPDATE schema_version SET version = 2;
+    """,
+
+    # Remember what each file looked like when it was indexed, so unchanged
+    # files can be skipped when the project is opened again.
+    """
+    ALTER TABLE files ADD COLUMN mtime REAL;
+    ALTER TABLE files ADD COLUMN size INTEGER;
+    ALTER TABLE files ADD COLUMN content_hash TEXT;
+
+    UPDATE schema_version SET version = 3;
+    """,
+
+    # Files parsed by a refresh that hasn't finished.  They're moved into
+    # files and symbols when it finishes, and kept if it's interrupted so the
+    # next refresh carries on from there.
+    """
+    CREATE TABLE pending_files (
+      file_path TEXT,
+      module_name TEXT,
+      mtime REAL,
+      size INTEGER,
+      content_hash TEXT
+    );
+    CREATE TABLE pending_symbols (
+      fileid INTEGER,
+      line_number INTEGER,
+      nameid INTEGER,
+      symbol_type INTEGER
+    );
+    CREATE INDEX pending_symbols_fileid ON pending_symbols (fileid);
+
+    UPDATE schema_version SET version = 4;
+    """,
+
+    # The global names each module defines, space separated, for auto-import
+    # completions.  Every file is parsed again to fill them in.
+    """
+    ALTER TABLE files ADD COLUMN global_names TEXT;
+    ALTER TABLE pending_files ADD COLUMN global_names TEXT;
+    UPDATE files SET mtime = NULL, size = NULL, content_hash = NULL;
+    DELETE FROM pending_files;
+    DELETE FROM pending_symbols;
+
+    UPDATE schema_version SET version = 5;
+    """,
   ]
 
-  def __init__(self, project):
+  # An FTS5 trigram index of the names, so any substring of a name can be
+  # found.  Only created if TRIGRAM_INDEX.  The trigger keeps it up to date;
+  # it's dropped if SQLite can't, and the index is rebuilt when it's created
+  # again.
+  TRIGRAM_SCHEMA = """
+    CREATE VIRTUAL TABLE IF NOT EXISTS symbol_index USING fts5(
+      name, content='names', tokenize='trigram');
+    INSERT INTO symbol_index (symbol_index) VALUES ('rebuild');
+
+    CREATE TRIGGER names_insert AFTER INSERT ON names BEGIN
+      INSERT INTO symbol_index (rowid, name) VALUES (new.rowid, new.name);
+    END;
+  """
+
+  # Only start a pool of processes when there are at least this many files to
+  # parse.
+  PARALLEL_THRESHOLD = 100
+  PARALLEL_CHUNK_SIZE = 16
+
+  # Number of parsed files Refresh commits at a time.
+  COMMIT_BATCH_SIZE = 200
+
+
+  def __init__(self, project, data_directory=None, processes=None):
+    """
+    The database is stored in data_directory, or the project's .ropeproject
+    folder if that is None.  Files are parsed by up to processes processes,
+    one per CPU if that is None.
+    """
+
     self.project = project
+    self.data_directory = data_directory or project.ropefolder.real_path
+    self.processes = processes or multiprocessing.cpu_count()
+
+    # Created by the first refresh or update.  It ignores the same files as
+    # the main project, which is only used on the thread that created this.
+    # Only the main project saves rope's object database.
+    self.parse_project = None
+    self.parse_prefs = {
+      "ignored_resources": list(project.ignored.patterns),
+      "save_objectdb": False,
+    }
 
-    # Open the database
-    db_filename = os.path.join(project.ropefolder.real_path,
-                               self.DATABASE_FILENAME)
-    self.conn = sqlite3.connect(db_filename)
+    # Files changed since the last ExportTable, which ExportOverlay writes.
+    self.overlay_files = set()
+
+    # Open the database.  This connection is used for writing, from whichever
+    # thread does the indexing.
+    self.db_filename = os.path.join(self.data_directory,
+                                    self.DATABASE_FILENAME)
+    self.conn = sqlite3.connect(self.db_filename, check_same_thread=False)
+    self.conn.execute("PRAGMA journal_mode = WAL")
+    self.conn.execute("PRAGMA synchronous = NORMAL")
 
     with self.conn:
       # Get the current schema version
@@ -62,138 +398,620 @@ class SymbolIndex(object):
         # Apply this schema update
         self.conn.executescript(self.SCHEMA[version])
 
-  def Rebuild(self):
+      self._CreateTrigramIndex()
+
+    self.read_conn = self._OpenReadConnection()
+    self.inherited_connections = []
+
+  def _CreateTrigramIndex(self):
+    """
+    Creates the trigram index if SQLite supports it and it's missing or out
+    of date.  Otherwise stops maintaining it.
+    """
+
+    has_trigger = self.conn.execute("""
+      SELECT 1 FROM sqlite_master WHERE type = 'trigger' AND name = ?
+    """, ("names_insert",)).fetchone() is not None
+
+    if not TRIGRAM_INDEX:
+      logging.warning("SQLite %s has no FTS5 trigram tokenizer, symbol "
+                      "searches will be slower", sqlite3.sqlite_version)
+      if has_trigger:
+        self.conn.execute("DROP TRIGGER names_insert")
+    elif not has_trigger:
+      self.conn.executescript(self.TRIGRAM_SCHEMA)
+
+  def _OpenReadConnection(self):
+    # Searches use it from one thread at a time, but Close can be called from
+    # the background thread.
+    conn = sqlite3.connect(
+        self.db_filename, cached_statements=SEARCH_CACHED_STATEMENTS,
+        check_same_thread=False)
+    conn.execute("PRAGMA query_only = ON")
+    return conn
+
+  def AfterFork(self):
+    """
+    Opens a new connection for searches in a forked child.  The parent's
+    connections are kept but never used or closed, because closing them here
+    could roll back a transaction the parent has open.
+    """
+
+    self.inherited_connections.append(self.read_conn)
+    self.read_conn = self._OpenReadConnection()
+
+  def Close(self):
+    """
+    Closes the database connections and the parsing project.
     """
-    Completely rebuilds the index by removing everything from the database and
-    parsing all the python files.
+
+    self.read_conn.close()
+    self.conn.close()
+    if self.parse_project is not None:
+      self.parse_project.close()
+      self.parse_project = None
+
+  def Refresh(self, progress=None, cancelled=None):
     """
+    Brings the index up to date with the python files on disk.  Files are only
+    parsed again if their modification time or size changed since they were
+    indexed and their contents are different.  Files that are no longer there
+    are removed.  Files are parsed in parallel when there are many of them,
+    but only this process writes to the database.
+
+    Parsed files are committed to the pending tables in batches, so an
+    interrupted refresh carries on where it left off next time, and searches
+    keep seeing the previous generation.  When every file is parsed they
+    replace the old versions in one transaction.  progress is called with the
+    number of files checked for changes and the total while they're checked,
+    then with the number parsed and the number to parse after each batch.  If
+    cancelled returns True between batches the refresh stops and returns
+    False, otherwise it returns True.
+    """
+
+    # Forget anything the parsing project cached from a previous refresh
+    if self.parse_project is not None:
+      self.parse_project.validate()
+
+    # Everything indexed so far, and everything an interrupted refresh parsed,
+    # by path.
+    indexed = {}
+    for row in self.conn.execute(
+        "SELECT file_path, rowid, mtime, size, content_hash FROM files"):
+      indexed[row[0]] = row[1:]
+
+    pending = {}
+    for row in self.conn.execute(
+        "SELECT file_path, rowid, mtime, size FROM pending_files"):
+      pending[row[0]] = row[1:]
+
+    to_parse = []
+    replaced = []
+
+    resources = list(self._PythonFiles())
+
+    with self.conn:
+      for checked, resource in enumerate(resources):
+        # Checking needs a stat of every file, and reading the ones that were
+        # touched, so it's done in batches too.
+        if checked % self.COMMIT_BATCH_SIZE == 0:
+          if cancelled is not None and cancelled():
+            return False
+          if progress is not None:
+            progress(checked, len(resources))
+
+        old = indexed.pop(resource.path, None)
+        new_mtime, new_size = self._FileState(resource)
+
+        parsed_before = pending.pop(resource.path, None)
+        if parsed_before is not None:
+          if parsed_before[1:] == (new_mtime, new_size):
+            if old is not None:
+              replaced.append(old[0])
+            continue
+          self._RemoveFile(parsed_before[0], pending=True)
+
+        if old is not None:
+          fileid, mtime, size, content_hash = old
+
+          if (new_mtime, new_size) == (mtime, size):
+            continue
+
+          if self._ContentHash(resource) == content_hash:
+            # Touched but not changed
+            self.conn.execute(
+              "UPDATE files SET mtime = ?, size = ? WHERE rowid = ?",
+              (new_mtime, new_size, fileid))
+            continue
+
+          # Keep the old symbols searchable until the refresh finishes
+          replaced.append(fileid)
+
+        to_parse.append(resource)
+
+      # Left over from an interrupted refresh, and since deleted
+      for fileid, _, _ in pending.itervalues():
+        self._RemoveFile(fileid, pending=True)
+
+    total = len(to_parse)
+    done = 0
+    if progress is not None:
+      progress(done, total)
+
+    parsed_files = self._ParseFiles(to_parse)
+    try:
+      while done < total:
+        if cancelled is not None and cancelled():
+          return False
+
+        batch = list(itertools.islice(parsed_files, self.COMMIT_BATCH_SIZE))
+        if not batch:
+          break
+
+        with self.conn:
+          for parsed in batch:
+            self._InsertFile(*parsed, pending=True)
+
+        done += len(batch)
+
+        if progress is not None:
+          progress(done, total)
+    finally:
+      # Stops the parsing processes if the refresh was cancelled
+      parsed_files.close()
 
     with self.conn:
-      self.conn.execute("DELETE FROM files")
-      self.conn.execute("DELETE FROM symbols")
-      self.conn.execute("DELETE FROM symbol_index")
+      # Anything left over was deleted
+      for fileid, _, _, _ in indexed.itervalues():
+        self._RemoveFile(fileid)
+
+      for fileid in replaced:
+        self._RemoveFile(fileid)
 
-      map(self._AddFile, self.project.pycore.get_python_files())
+      self._MovePendingFiles()
+      self._RemoveUnusedNames()
 
-  def UpdateFile(self, file_path):
+    return True
+
+  def UpdateFiles(self, file_paths):
     """
-    Updates a single file in the index.
+    Updates the given files in the index in a single transaction.  Files that
+    no longer exist or are no longer python files are removed from the index.
     """
 
-    # Find this file in the project
-    resource = self.project.get_resource(file_path)
+    # Make rope notice that the files changed on disk.  rope can only
+    # validate things that still exist, so validate the nearest folder that
+    # does.
+    parse_project = self._ParseProject()
+    for file_path in file_paths:
+      folder = parse_project.get_file(file_path).parent
+      while not folder.exists():
+        folder = folder.parent
+      parse_project.validate(folder)
 
     with self.conn:
-      # Did this file exist already?
-      row = self.conn.execute(
-        "SELECT rowid FROM files WHERE file_path = ?",
-        (file_path, )).fetchone()
+      for file_path in file_paths:
+        # Did this file exist already?
+        row = self.conn.execute(
+          "SELECT rowid FROM files WHERE file_path = ?",
+          (file_path, )).fetchone()
 
-      if row is not None:
-        # Remove the existing data for this file
-        self._RemoveFile(row[0])
+        if row is not None:
+          # Remove the existing data for this file
+          self._RemoveFile(row[0])
 
-      # Re-parse the file
-      self._AddFile(resource)
+        resource = parse_project.get_file(file_path)
+        if resource.exists() and \
+           not parse_project.is_ignored(resource) and \
+           parse_project.pycore.is_python_file(resource):
+          self._AddFile(resource)
 
   def Search(self, query, file_path=None, symbol_type=None, limit=1000):
     """
     Searches for the given query string in the index and returns an iterator
     over (module_name, file_path, line_number, symbol_name, symbol_type) tuples.
+    Each word in the query can match anywhere in the symbol name.  Names that
+    start with the first word come first, then shorter names.
     If file_path is not None, only symbols in that file are returned.
     If symbol_type is not None, only symbols of that given type are returned.
     """
 
-    # Remove special FTS characters from the user's query.  The .lower() removes
-    # NEAR/n instructions as well.
-    fts_query = re.sub(r'\W+', ' ', query.lower())
+    results = _RankedSearch(self.read_conn, [("main", self.project.address)],
+                            query, file_path, symbol_type, limit)
+    return (x[2:] for x in results)
 
-    # Stick * on the end of each search term
-    fts_query = " ".join("%s*" % x for x in fts_query.split(" "))
+  def GlobalNames(self, file_paths=None):
+    """
+    Returns an iterator over (module_name, [global name]) for every file in
+    the index, or just the given ones.  Names that start with an underscore
+    are left out.  Called from the thread that does the indexing.
+    """
 
-    # Build the WHERE section of the query.
-    where_clauses = [
-      "i.content MATCH ?",
-      "i.rowid = s.rowid",
-      "s.fileid = f.rowid",
-    ]
-    where_parameters = [
-      fts_query,
-    ]
+    if file_paths is None:
+      rows = self.conn.execute("SELECT module_name, global_names FROM files")
+    else:
+      rows = itertools.chain.from_iterable(
+          self.conn.execute("""
+            SELECT module_name, global_names FROM files WHERE file_path = ?
+          """, (x,)) for x in file_paths)
 
-    if file_path is not None:
-      where_clauses.append("f.file_path = ?")
-      where_parameters.append(file_path)
-
-    if symbol_type is not None:
-      where_clauses.append("s.symbol_type = ?")
-      where_parameters.append(symbol_type)
-
-    # Build the query
-    sql = """
-      SELECT f.module_name,
-             f.file_path,
-             s.line_number,
-             s.symbol_name,
-             s.symbol_type
-      FROM files AS f,
-           symbols AS s,
-           symbol_index AS i
-      WHERE %s
-      LIMIT ?
-    """ % " AND ".join(where_clauses)
-
-    # Execute the query
-    return self.conn.execute(sql, tuple(where_parameters + [limit]))
+    return ((module_name, (global_names or "").split())
+            for module_name, global_names in rows)
 
-  def _AddFile(self, resource):
+  def ExportTable(self):
     """
-    Parses the resource and adds all its symbols to the database.
-    The database connection MUST already be in a transaction.
+    Writes the whole index to an immutable file that the plugin maps into
+    memory to answer locator queries without asking the worker.  Symbols are
+    sorted by lowercase name, with a trigram index for substring queries.
+    The file is replaced atomically, so a reader always sees one complete
+    generation.  Any overlay is removed.  Returns the path of the file.
     """
 
-    # Open this file
-    try:
-      pyobject  = self.project.pycore.resource_to_pyobject(resource)
-    except rope.base.exceptions.RopeError:
-      # If the file couldn't be loaded, ignore it
+    filename = os.path.join(self.data_directory, self.TABLE_FILENAME)
+    self._WriteTable(
+        filename,
+        self.conn.execute(
+            "SELECT rowid, file_path, module_name FROM files ORDER BY rowid"),
+        self.conn.execute("""
+            SELECT s.fileid, s.line_number, n.name, s.symbol_type
+            FROM symbols AS s, names AS n
+            WHERE s.nameid = n.rowid
+            """))
+
+    self.overlay_files.clear()
+    overlay_filename = os.path.join(self.data_directory, self.OVERLAY_FILENAME)
+    if os.path.exists(overlay_filename):
+      os.remove(overlay_filename)
+
+    return filename
+
+  def ExportOverlay(self, file_paths):
+    """
+    Exports the given files after UpdateFiles changed them.  Writing the whole
+    table takes seconds on large projects, so instead the files changed since
+    the last ExportTable are written to a small overlay table in the same
+    format.  The plugin hides the main table's symbols in the overlay's files,
+    including files that were removed and have no symbols left.  Once the
+    overlay has more than OVERLAY_MAX_FILES files the whole table is exported
+    again.
+
+    Returns the paths of the table and the overlay, which is None if there is
+    none.
+    """
+
+    self.overlay_files.update(file_paths)
+
+    filename = os.path.join(self.data_directory, self.TABLE_FILENAME)
+    if len(self.overlay_files) > self.OVERLAY_MAX_FILES or \
+       not os.path.exists(filename):
+      return self.ExportTable(), None
+
+    files = []
+    file_ids = []
+    for file_path in sorted(self.overlay_files):
+      row = self.conn.execute(
+          "SELECT rowid, file_path, module_name FROM files "
+          "WHERE file_path = ?", (file_path, )).fetchone()
+      if row is None:
+        files.append((file_path, file_path, None))
+      else:
+        files.append(row)
+        file_ids.append(row[0])
+
+    symbols = []
+    for fileid in file_ids:
+      symbols.extend(self.conn.execute("""
+          SELECT s.fileid, s.line_number, n.name, s.symbol_type
+          FROM symbols AS s, names AS n
+          WHERE s.fileid = ? AND s.nameid = n.rowid
+          """, (fileid, )))
+
+    overlay_filename = os.path.join(self.data_directory, self.OVERLAY_FILENAME)
+    self._WriteTable(overlay_filename, files, symbols)
+    return filename, overlay_filename
+
+  def _WriteTable(self, filename, file_rows, symbol_rows):
+    """
+    Writes a symbol table.  file_rows are (key, file path, module name) and
+    symbol_rows are (file key, line number, name, type).
+    """
+
+    project_dir = self.project.address
+
+    strings = []
+    strings_size = [0]
+
+    def AddString(value):
+      """
+      Appends value to the string table, returns its (offset, length).
+      """
+
+      if isinstance(value, unicode):
+        value = value.encode("utf-8")
+      offset = strings_size[0]
+      strings.append(value)
+      strings_size[0] += len(value)
+      return offset, len(value)
+
+    # Files, renumbered from 0.
+    file_ids = {}
+    files = []
+    for key, file_path, module_name in file_rows:
+      file_ids[key] = len(files)
+      files.append(AddString(os.path.join(project_dir, file_path)) +
+                   AddString(module_name or ""))
+
+    # Symbols, sorted by lowercase name.
+    rows = []
+    for key, line_number, symbol_name, symbol_type in symbol_rows:
+      if key not in file_ids:
+        continue
+      name = symbol_name.encode("utf-8")
+      rows.append((name.lower(), name, file_ids[key], line_number,
+                   symbol_type))
+    rows.sort()
+
+    symbols = []
+    trigrams = {}
+    for index, (lower_name, name, fileid, line_number, symbol_type) in \
+        enumerate(rows):
+      symbols.append(AddString(name) + (fileid, line_number, symbol_type))
+
+      for i in xrange(len(lower_name) - 2):
+        key = (ord(lower_name[i]) << 16 | ord(lower_name[i+1]) << 8 |
+               ord(lower_name[i+2]))
+        postings = trigrams.setdefault(key, [])
+        if not postings or postings[-1] != index:
+          postings.append(index)
+
+    # Work out where everything goes.
+    trigram_keys = sorted(trigrams)
+    files_offset = self.TABLE_HEADER.size
+    symbols_offset = files_offset + len(files) * self.TABLE_FILE.size
+    trigrams_offset = symbols_offset + len(symbols) * self.TABLE_SYMBOL.size
+    postings_offset = trigrams_offset + \
+                      len(trigram_keys) * self.TABLE_TRIGRAM.size
+    strings_offset = postings_offset + \
+        sum(len(x) for x in trigrams.itervalues()) * self.TABLE_POSTING.size
+
+    # Write it to a temporary file and move it over the old one.
+    temp_filename = "%s.%d" % (filename, os.getpid())
+    with open(temp_filename, "wb") as handle:
+      handle.write(self.TABLE_HEADER.pack(
+          self.TABLE_MAGIC, self.TABLE_VERSION, self._NextTableGeneration(),
+          len(files), len(symbols), len(trigram_keys),
+          files_offset, symbols_offset, trigrams_offset, postings_offset,
+          strings_offset))
+
+      for record in files:
+        handle.write(self.TABLE_FILE.pack(*record))
+      for record in symbols:
+        handle.write(self.TABLE_SYMBOL.pack(*record))
+
+      first_posting = 0
+      for key in trigram_keys:
+        count = len(trigrams[key])
+        handle.write(self.TABLE_TRIGRAM.pack(key, first_posting, count))
+        first_posting += count
+      for key in trigram_keys:
+        handle.write("".join(self.TABLE_POSTING.pack(x)
+                             for x in trigrams[key]))
+
+      handle.write("".join(strings))
+
+    os.rename(temp_filename, filename)
+
+  def _NextTableGeneration(self):
+    """
+    Returns the generation number for a new symbol table or overlay, one more
+    than the newest of the existing ones.  They share one sequence so an
+    overlay written after the old one was removed still looks new.
+    """
+
+    generation = 0
+    for name in (self.TABLE_FILENAME, self.OVERLAY_FILENAME):
+      try:
+        with open(os.path.join(self.data_directory, name), "rb") as handle:
+          header = self.TABLE_HEADER.unpack(
+              handle.read(self.TABLE_HEADER.size))
+      except (IOError, struct.error):
+        continue
+
+      if header[0] == self.TABLE_MAGIC:
+        generation = max(generation, header[2])
+    return generation + 1
+
+  def _PythonFiles(self):
+    """
+    Yields all the python files in the project that aren't ignored.  This
+    walks the directory tree itself because building rope's cached file list
+    takes over a minute on projects with thousands of files.
+    """
+
+    project = self._ParseProject()
+    root = project.address
+
+    for dirpath, dirnames, filenames in os.walk(root):
+      prefix = os.path.relpath(dirpath, root)
+      if prefix == os.curdir:
+        prefix = ""
+      else:
+        prefix = prefix.replace(os.sep, "/") + "/"
+
+      dirnames[:] = [x for x in dirnames
+                     if not project.is_ignored(project.get_folder(prefix + x))]
+
+      for filename in filenames:
+        resource = project.get_file(prefix + filename)
+        if not project.is_ignored(resource) and \
+           project.pycore.is_python_file(resource):
+          yield resource
+
+  @staticmethod
+  def _FileState(resource):
+    """
+    Returns the (mtime, size) of the resource on disk.
+    """
+
+    stat = os.stat(resource.real_path)
+    return stat.st_mtime, stat.st_size
+
+  @staticmethod
+  def _ContentHash(resource):
+    """
+    Returns a hash of the resource's contents.
+    """
+
+    with open(resource.real_path, "rb") as handle:
+      return hashlib.sha1(handle.read()).hexdigest()
+
+  def _ParseFiles(self, resources):
+    """
+    Parses the resources and yields a ParseFile result for each one, in any
+    order.  Uses a pool of processes if there are enough resources.
+    """
+
+    can_fork, after_fork = _fork_hooks
+    if self.processes <= 1 or len(resources) < self.PARALLEL_THRESHOLD or \
+       not can_fork():
+      parse_project = self._ParseProject()
+      for resource in resources:
+        yield self.ParseFile(parse_project,
+                             parse_project.get_file(resource.path))
       return
 
-    module_name = self.project.pycore.modname(resource)
-    file_path   = resource.path
+    pool = multiprocessing.Pool(
+        min(self.processes, len(resources) // self.PARALLEL_CHUNK_SIZE + 1),
+        _InitPoolProcess, (self.project.address, self.parse_prefs, after_fork))
+    try:
+      for parsed in pool.imap_unordered(
+          _ParseInPoolProcess, [x.path for x in resources],
+          self.PARALLEL_CHUNK_SIZE):
+        yield parsed
+      pool.close()
+    except:
+      pool.terminate()
+      raise
+    finally:
+      pool.join()
+
+  def _RopeFolderName(self):
+    """
+    Returns the name of the main project's rope folder, or None.
+    """
+
+    if self.project.ropefolder is None:
+      return None
+    return self.project.ropefolder.name
+
+  def _ParseProject(self):
+    """
+    Returns the rope project used to parse files in this process, opening it
+    the first time.
+    """
+
+    if self.parse_project is None:
+      self.parse_project = rope.base.project.Project(
+          self.project.address, ropefolder=self._RopeFolderName(),
+          **self.parse_prefs)
+    return self.parse_project
 
-    # Get the list of symbols in the module
+  @classmethod
+  def ParseFile(cls, project, resource):
+    """
+    Parses the resource and returns a (file_path, module_name, mtime, size,
+    content_hash, symbols, global_names) tuple for _InsertFile.  This doesn't
+    touch the database, so it can run in another process.
+    """
+
+    mtime, size = cls._FileState(resource)
+    content_hash = cls._ContentHash(resource)
+
+    # Get the list of symbols in the module.  Files that can't be parsed are
+    # still added, without any symbols, so they aren't parsed again until
+    # they change.
     symbols = []
-    self._WalkPyObject(pyobject, None, symbols)
+    global_names = []
+    try:
+      pyobject = project.pycore.resource_to_pyobject(resource)
+    except rope.base.exceptions.RopeError:
+      pass
+    else:
+      cls._WalkPyObject(pyobject, None, symbols)
+      global_names = cls._GlobalNames(pyobject)
 
-    # Add the file to the database
-    fileid = self.conn.execute(
-      "INSERT INTO files (module_name, file_path) VALUES (?, ?)",
-      (module_name, file_path)).lastrowid
+    return (resource.path, project.pycore.modname(resource),
+            mtime, size, content_hash, symbols, " ".join(global_names))
+
+  @staticmethod
+  def _GlobalNames(pymodule):
+    """
+    Returns the names pymodule defines or assigns at the top level that don't
+    start with an underscore, the same ones rope's AutoImport finds.
+    """
+
+    try:
+      attributes = pymodule._get_structural_attributes() # pylint: disable=W0212
+    except Exception:
+      # Ignore any errors from rope
+      return []
 
-    # Add each symbol to the database
-    for symbol_name, line_number, symbol_type in symbols:
-      self._AddSymbol(fileid, line_number, symbol_name, symbol_type)
+    return [name for name, pyname in attributes.iteritems()
+            if not name.startswith("_") and
+               isinstance(pyname, (rope.base.pynames.AssignedName,
+                                   rope.base.pynames.DefinedName))]
 
-  def _AddSymbol(self, fileid, line_number, symbol_name, symbol_type):
+  def _AddFile(self, resource):
     """
-    Adds the Python symbol to the database.
+    Parses the resource and adds all its symbols to the database.
     The database connection MUST already be in a transaction.
     """
 
-    cursor = self.conn.execute("""
-      INSERT INTO symbols (fileid, line_number, symbol_name, symbol_type)
-      VALUES (?, ?, ?, ?)
-    """, (fileid, line_number, symbol_name, symbol_type))
+    parse_project = self._ParseProject()
+    self._InsertFile(*self.ParseFile(parse_project,
+                                     parse_project.get_file(resource.path)))
+
+  @staticmethod
+  def _Tables(pending):
+    """
+    Returns the names of the (files, symbols) tables, or the pending ones.
+    """
+
+    if pending:
+      return "pending_files", "pending_symbols"
+    return "files", "symbols"
 
-    rowid = cursor.lastrowid
+  def _InsertFile(self, file_path, module_name, mtime, size, content_hash,
+                  symbols, global_names, pending=False):
+    """
+    Adds a parsed file and its symbols to the database, or to the pending
+    tables.  The database connection MUST already be in a transaction.
+    """
 
-    self.conn.execute("""
-      INSERT INTO symbol_index (rowid, content)
-      VALUES (?, ?)
-    """, (rowid, symbol_name))
+    files_table, symbols_table = self._Tables(pending)
+
+    # Add the file to the database
+    fileid = self.conn.execute("""
+      INSERT INTO %s (module_name, file_path, mtime, size, content_hash,
+                      global_names)
+      VALUES (?, ?, ?, ?, ?, ?)
+    """ % files_table,
+    (module_name, file_path, mtime, size, content_hash,
+     global_names)).lastrowid
+
+    # Add any new names, then the symbols themselves
+    self.conn.executemany(
+      "INSERT OR IGNORE INTO names (name) VALUES (?)",
+      ((symbol_name,) for symbol_name, _, _ in symbols))
+
+    self.conn.executemany("""
+      INSERT INTO %s (fileid, line_number, nameid, symbol_type)
+      SELECT ?, ?, rowid, ? FROM names WHERE name = ?
+    """ % symbols_table, ((fileid, line_number, symbol_type, symbol_name)
+          for symbol_name, line_number, symbol_type in symbols))
 
-  def _WalkPyObject(self, pyobject, dotted_name, ret):
+  @classmethod
+  def _WalkPyObject(cls, pyobject, dotted_name, ret):
     """
     Walks pyobject and all its children, adding a tuple for each one to ret.
     """
@@ -224,25 +1042,159 @@ class SymbolIndex(object):
         if dotted_name is not None:
           name = "%s.%s" % (dotted_name, name)
 
-        self._WalkPyObject(pyname.get_object(), name, ret)
+        cls._WalkPyObject(pyname.get_object(), name, ret)
 
-  def _RemoveFile(self, fileid):
+  def _RemoveFile(self, fileid, pending=False):
     """
-    Removes the file with the give rowid from the database.
+    Removes the file with the give rowid from the database, or from the
+    pending tables.
     """
 
+    files_table, symbols_table = self._Tables(pending)
+
     # Remove the file itself
-    self.conn.execute("DELETE FROM files WHERE rowid = ?", (fileid,))
+    self.conn.execute("DELETE FROM %s WHERE rowid = ?" % files_table,
+                      (fileid,))
+
+    # Remove any symbols in the file.  Their names stay in the names table
+    # until the next refresh, but without symbols they never match a search.
+    self.conn.execute("DELETE FROM %s WHERE fileid = ?" % symbols_table,
+                      (fileid,))
+
+  def _MovePendingFiles(self):
+    """
+    Moves everything in the pending tables into the files and symbols tables.
+    The database connection MUST already be in a transaction.
+    """
+
+    for pending_id, in self.conn.execute(
+        "SELECT rowid FROM pending_files").fetchall():
+      fileid = self.conn.execute("""
+        INSERT INTO files (module_name, file_path, mtime, size, content_hash,
+                           global_names)
+        SELECT module_name, file_path, mtime, size, content_hash, global_names
+        FROM pending_files WHERE rowid = ?
+      """, (pending_id,)).lastrowid
+
+      self.conn.execute("""
+        INSERT INTO symbols (fileid, line_number, nameid, symbol_type)
+        SELECT ?, line_number, nameid, symbol_type
+        FROM pending_symbols WHERE fileid = ?
+      """, (fileid, pending_id))
+
+    self.conn.execute("DELETE FROM pending_symbols")
+    self.conn.execute("DELETE FROM pending_files")
+
+  def _RemoveUnusedNames(self):
+    """
+    Removes names that no symbol uses any more from the names table and the
+    full text index.
+    """
+
+    if TRIGRAM_INDEX:
+      self.conn.execute("""
+        INSERT INTO symbol_index (symbol_index, rowid, name)
+        SELECT 'delete', rowid, name FROM names
+        WHERE rowid NOT IN (SELECT nameid FROM symbols)
+      """)
+    self.conn.execute("""
+      DELETE FROM names
+      WHERE rowid NOT IN (SELECT nameid FROM symbols)
+    """)
+
+
+class SymbolSearcher(object):
+  """
+  Searches the indexes of all the open projects, and the library indexes, at
+  once.  The index databases are attached to in-memory connections and
+  searched with one ranked query per connection.  SQLite can only attach a
+  few databases to each connection, so with many projects open the results
+  of a few queries are merged.
+  """
+
+  MAX_ATTACHED = 10
+
+  def __init__(self):
+    # db_filename: root directory
+    self.databases = collections.OrderedDict()
+
+    # List of (connection, [(schema name, root directory)]), or None if it
+    # needs creating again
+    self.connections = None
+    self.inherited_connections = []
+
+  def Add(self, db_filename, root):
+    """
+    Adds an index database whose file paths are relative to root.
+    """
+
+    if db_filename not in self.databases:
+      self.databases[db_filename] = root
+      self._CloseConnections()
+
+  def Remove(self, db_filename):
+    """
+    Stops searching an index database.
+    """
+
+    if db_filename in self.databases:
+      del self.databases[db_filename]
+      self._CloseConnections()
+
+  def Search(self, query, symbol_type=None, limit=1000):
+    """
+    Searches all the index databases and returns an iterator over at most limit
+    (module_name, file_path, line_number, symbol_name, symbol_type) tuples,
+    ranked like SymbolIndex.Search.  File paths are absolute.
+    """
+
+    results = heapq.merge(*[
+        _RankedSearch(conn, databases, query, None, symbol_type, limit)
+        for conn, databases in self._Connections()])
+
+    return (x[2:] for x in itertools.islice(results, limit))
+
+  def AfterFork(self):
+    """
+    Makes the next search in a forked child create its own connections.  The
+    parent's are kept but never used or closed.
+    """
+
+    if self.connections is not None:
+      self.inherited_connections.append(self.connections)
+      self.connections = None
+
+  def _Connections(self):
+    """
+    Returns the list of (connection, databases), creating the connections if
+    the list of databases changed.
+    """
+
+    if self.connections is None:
+      self.connections = []
+
+      items = self.databases.items()
+      for start in xrange(0, len(items), self.MAX_ATTACHED):
+        conn = sqlite3.connect(":memory:",
+                               cached_statements=SEARCH_CACHED_STATEMENTS)
+        databases = []
+
+        for db_filename, root in items[start:start + self.MAX_ATTACHED]:
+          schema = "db%d" % len(databases)
+          conn.execute("ATTACH DATABASE ? AS %s" % schema, (db_filename,))
+          databases.append((schema, root))
+
+        conn.execute("PRAGMA query_only = ON")
+        self.connections.append((conn, databases))
 
-    # Remove any symbols in the file
-    for row in self.conn.execute("SELECT rowid FROM symbols WHERE fileid = ?",
-                                 (fileid,)):
-      self._RemoveSymbol(row[0])
+    return self.connections
 
-  def _RemoveSymbol(self, rowid):
+  def _CloseConnections(self):
     """
-    Removes the symbol with the given rowid from the database.
+    Closes all the connections, they are created again by the next search.
     """
 
-    self.conn.execute("DELETE FROM symbols WHERE rowid = ?", (rowid,))
-    self.conn.execute("DELETE FROM symbol_index WHERE rowid = ?", (rowid,))
+    if self.connections is not None:
+      for conn, _ in self.connections:
+        conn.close()
+      self.connections = None
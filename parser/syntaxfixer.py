@@ -0,0 +1,244 @@
+"""
+Makes modules out of code with syntax errors in it, parsing the whole module
+as few times as possible.
+"""
+
+import ast
+import bisect
+import re
+
+from rope.base import codeanalyze, exceptions, fscommands, simplify
+from rope.contrib import fixsyntax
+
+
+class SyntaxFixer(object):
+  """
+  rope's FixSyntax comments out the line of one syntax error and parses the
+  whole module again, up to maxfixes times, so code with a few errors in it is
+  parsed many times per request.
+
+  This fixes errors a top-level statement at a time instead.  Each statement
+  that doesn't parse on its own is parsed again by itself until it does, which
+  is cheap, and the whole module is only parsed again after that.  The first
+  time the module fails to parse every top-level statement is checked, so all
+  the broken ones are fixed in one go.
+
+  The lines that had errors in the previous version of the buffer are passed
+  in as hints, and their statements are fixed before the first parse.  Typing
+  inside a broken function then usually costs one parse of the module.
+
+  Lines are commented out with the FixSyntax's own commenter, so offsets in the
+  fixed code map back to the buffer the same way they do with rope's fixes.
+  """
+
+  # Lines starting with these words belong to the statement above them.
+  CONTINUATION_WORDS = frozenset(["elif", "else", "except", "finally"])
+
+  WORD_RE = re.compile(r"[A-Za-z_]\w*")
+
+  def __init__(self, fixer):
+    self.fixer = fixer
+    self.encoding = fscommands.read_str_coding(fixer.code)
+    self.errors = []
+    self.error_lines = []
+
+  def GetPyModule(self, hint_lines=()):
+    """
+    Returns the PyModule for the fixer's code.  error_lines is set to the
+    lines that had to be fixed, to pass as hints for the next version.
+    """
+
+    pycore = self.fixer.pycore
+    resource = self.fixer.resource
+    code = self.fixer.code
+
+    if resource is not None and resource.read() == code:
+      return pycore.resource_to_pyobject(resource, force_errors=True)
+
+    for lineno in hint_lines:
+      self.FixStatementAt(lineno)
+
+    checked_statements = False
+    while True:
+      try:
+        if self.error_lines:
+          code = self.Code()
+        return pycore.get_string_module(
+            code, resource=resource, force_errors=True)
+      except exceptions.ModuleSyntaxError, ex:
+        if checked_statements or not self.FixAllStatements():
+          # The statement parses by itself, so the error needs the rest of
+          # the module.  Fall back to fixing it the way rope does.
+          self.Comment(ex.lineno, ex.message_)
+        checked_statements = True
+
+  @property
+  def commenter(self):
+    # Only made once there's something to fix, as rope does
+    return self.fixer.commenter
+
+  def Code(self):
+    return "\n".join(self.commenter.lines)
+
+  def Comment(self, lineno, message):
+    """
+    Comments out the statement at lineno, counted from 1, or raises
+    ModuleSyntaxError if too many lines were commented out already.
+    """
+
+    if len(self.errors) >= self.fixer.maxfixes:
+      self.errors.append("  * line %s: %s ... raised!" % (lineno, message))
+      filename = "string"
+      if self.fixer.resource is not None:
+        filename = self.fixer.resource.path
+      raise exceptions.ModuleSyntaxError(filename, lineno,
+          "\nSyntax errors in file %s:\n%s" % (
+              filename, "\n".join(self.errors)))
+
+    self.errors.append("  * line %s: %s ... fixed" % (lineno, message))
+    self.error_lines.append(lineno)
+    self.commenter.comment(lineno)
+
+  def StatementStarts(self):
+    """
+    Returns the indexes of the lines that start a top-level statement.
+    """
+
+    code = self.Code()
+    simplified = simplify.real_code(code)
+
+    ret = []
+    offset = 0
+    index = 0
+    decorated = False
+    while True:
+      # real_code keeps a newline only if it's not inside brackets, a string
+      # or an explicit continuation.
+      if (offset == 0 or simplified[offset - 1] == "\n") and \
+         offset < len(code) and not simplified[offset].isspace():
+        match = self.WORD_RE.match(simplified, offset)
+        if not decorated and \
+           (match is None or match.group() not in self.CONTINUATION_WORDS):
+          ret.append(index)
+        decorated = simplified[offset] == "@"
+
+      offset = code.find("\n", offset) + 1
+      if offset == 0:
+        break
+      index += 1
+
+    return ret
+
+  def StatementBounds(self, index):
+    """
+    Returns the line indexes (start, end) of the top-level statement containing
+    line index.
+    """
+
+    starts = self.StatementStarts()
+    i = bisect.bisect_right(starts, index)
+    start = starts[i - 1] if i > 0 else 0
+    end = starts[i] if i < len(starts) else len(self.commenter.lines)
+    return start, end
+
+  def FixStatement(self, start, end):
+    """
+    Comments out lines of the statement from line index start up to end until
+    it parses by itself.  Returns True if anything was commented out.
+    """
+
+    ret = False
+    while True:
+      lines = self.commenter.lines[start:end]
+      error = self._ParseError("\n".join(lines))
+      if error is None:
+        return ret
+
+      lineno, message = error
+      lineno = min(max(lineno or 1, 1), len(lines))
+      line_count = len(self.commenter.lines)
+      self.Comment(start + lineno, message)
+      ret = True
+
+      if end >= line_count:
+        # An unclosed bracket or string makes the statement run to the end of
+        # the file, so look for its end again now part of it is commented out.
+        end = self.StatementBounds(start)[1]
+      else:
+        # Commenting can add lines to close incomplete try blocks
+        end += len(self.commenter.lines) - line_count
+
+  def FixStatementAt(self, lineno):
+    """
+    Fixes the top-level statement containing lineno, counted from 1.
+    """
+
+    if lineno is None or not 0 < lineno <= len(self.commenter.lines):
+      return False
+
+    return self.FixStatement(*self.StatementBounds(lineno - 1))
+
+  def FixAllStatements(self):
+    """
+    Fixes every top-level statement that doesn't parse by itself.  Returns True
+    if anything was commented out.
+    """
+
+    starts = self.StatementStarts()
+    bounds = zip([0] + starts, starts + [len(self.commenter.lines)])
+
+    # Last first, so lines added while fixing one don't move the others
+    ret = False
+    for start, end in reversed(bounds):
+      if start < end and self.FixStatement(start, end):
+        ret = True
+    return ret
+
+  def _ParseError(self, text):
+    """
+    Returns (lineno, message) of the first syntax error in text, or None.
+    """
+
+    if isinstance(text, unicode):
+      try:
+        text = fscommands.unicode_to_file_data(text, self.encoding)
+      except (UnicodeError, LookupError):
+        text = text.encode("utf-8")
+
+    try:
+      ast.parse(text)
+    except SyntaxError, ex:
+      return ex.lineno, ex.msg
+    except (TypeError, ValueError), ex:
+      return 1, str(ex)
+    return None
+
+
+class Commenter(fixsyntax._Commenter):  # pylint: disable=W0212
+  """
+  rope's commenter, except that looking for try blocks the commented line is
+  in stops at its top-level statement.  rope walks back through every block to
+  the start of the file, which takes longer than parsing it on large modules.
+  """
+
+  def _fix_incomplete_try_blocks(self, lineno, indents):
+    lines = codeanalyze.ArrayLinesAdapter(self.lines)
+    block_start = lineno
+    last_indents = indents
+    while block_start > 0:
+      block_start = codeanalyze.get_block_start(lines, block_start) - 1
+      line = self.lines[block_start]
+      line_indents = fixsyntax._get_line_indents(line)  # pylint: disable=W0212
+
+      if line.strip().startswith("try:") and line_indents <= last_indents:
+        last_indents = line_indents
+        block_end = self._find_matching_deindent(block_start)
+        end_line = self.lines[block_end].strip()
+        if not (end_line.startswith("finally:") or
+                end_line.startswith("except ") or
+                end_line.startswith("except:")):
+          self._insert(block_end, " " * line_indents + "finally:")
+          self._insert(block_end + 1, " " * line_indents + "    pass")
+
+      if line_indents == 0 and line.strip():
+        break
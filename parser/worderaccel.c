@@ -0,0 +1,214 @@
+/*  pyqtc - QtCreator plugin with code completion using rope.
+    Copyright 2011 David Sansome <me@davidsansome.com>
+    Copyright 2017 Alexander Izmailov <yarolig@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* C versions of the scans rope's worder and simplify modules make over the
+   whole buffer for every request.  They give exactly the same results as the
+   python code, for both str and unicode.  See worderaccel.py. */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <ctype.h>
+#include <string.h>
+
+#define CHAR char
+#define FUNC(name) name##_str
+#define IS_SPACE(c) isspace(Py_CHARMASK(c))
+#define IS_ALNUM(c) isalnum(Py_CHARMASK(c))
+#include "worderaccel_template.h"
+#undef CHAR
+#undef FUNC
+#undef IS_SPACE
+#undef IS_ALNUM
+
+#define CHAR Py_UNICODE
+#define FUNC(name) name##_unicode
+#define IS_SPACE(c) Py_UNICODE_ISSPACE(c)
+#define IS_ALNUM(c) Py_UNICODE_ISALNUM(c)
+#include "worderaccel_template.h"
+#undef CHAR
+#undef FUNC
+#undef IS_SPACE
+#undef IS_ALNUM
+
+
+static int AppendRegion(Py_ssize_t start, Py_ssize_t end, void* data) {
+  PyObject* list = (PyObject*) data;
+  PyObject* region = Py_BuildValue("(nn)", start, end);
+  int ret;
+
+  if (!region)
+    return -1;
+  ret = PyList_Append(list, region);
+  Py_DECREF(region);
+  return ret;
+}
+
+static PyObject* IgnoredRegions(PyObject* self, PyObject* args) {
+  PyObject* source;
+  PyObject* ret;
+  int error;
+
+  if (!PyArg_ParseTuple(args, "O:ignored_regions", &source))
+    return NULL;
+
+  ret = PyList_New(0);
+  if (!ret)
+    return NULL;
+
+  if (PyUnicode_Check(source)) {
+    error = scan_ignored_unicode(PyUnicode_AS_UNICODE(source),
+                                 PyUnicode_GET_SIZE(source),
+                                 AppendRegion, ret);
+  } else if (PyString_Check(source)) {
+    error = scan_ignored_str(PyString_AS_STRING(source),
+                             PyString_GET_SIZE(source), AppendRegion, ret);
+  } else {
+    PyErr_SetString(PyExc_TypeError, "expected str or unicode");
+    error = -1;
+  }
+
+  if (error < 0) {
+    Py_DECREF(ret);
+    return NULL;
+  }
+  return ret;
+}
+
+static PyObject* RealCode(PyObject* self, PyObject* args) {
+  PyObject* source;
+  PyObject* ret;
+  Py_ssize_t size;
+
+  if (!PyArg_ParseTuple(args, "O:real_code", &source))
+    return NULL;
+
+  if (PyUnicode_Check(source)) {
+    size = PyUnicode_GET_SIZE(source);
+    ret = PyUnicode_FromUnicode(NULL, size);
+    if (ret) {
+      real_code_unicode(PyUnicode_AS_UNICODE(source),
+                        PyUnicode_AS_UNICODE(ret), size);
+    }
+    return ret;
+  }
+
+  if (PyString_Check(source)) {
+    size = PyString_GET_SIZE(source);
+    ret = PyString_FromStringAndSize(NULL, size);
+    if (ret) {
+      real_code_str(PyString_AS_STRING(source), PyString_AS_STRING(ret), size);
+    }
+    return ret;
+  }
+
+  PyErr_SetString(PyExc_TypeError, "expected str or unicode");
+  return NULL;
+}
+
+/* Parses (code, offset) arguments.  offset has to be inside code. */
+static int ParseOffsetArgs(PyObject* args, const char* format,
+                           PyObject** code, Py_ssize_t* offset) {
+  Py_ssize_t size;
+
+  if (!PyArg_ParseTuple(args, format, code, offset))
+    return 0;
+
+  if (PyUnicode_Check(*code)) {
+    size = PyUnicode_GET_SIZE(*code);
+  } else if (PyString_Check(*code)) {
+    size = PyString_GET_SIZE(*code);
+  } else {
+    PyErr_SetString(PyExc_TypeError, "expected str or unicode");
+    return 0;
+  }
+
+  if (*offset < 0 || *offset >= size) {
+    PyErr_SetString(PyExc_IndexError, "offset out of range");
+    return 0;
+  }
+  return 1;
+}
+
+static PyObject* FindLastNonSpaceChar(PyObject* self, PyObject* args) {
+  PyObject* code;
+  Py_ssize_t offset;
+
+  if (!ParseOffsetArgs(args, "On:find_last_non_space_char", &code, &offset))
+    return NULL;
+
+  if (PyUnicode_Check(code)) {
+    offset = find_last_non_space_char_unicode(PyUnicode_AS_UNICODE(code),
+                                              offset);
+  } else {
+    offset = find_last_non_space_char_str(PyString_AS_STRING(code), offset);
+  }
+  return PyInt_FromSsize_t(offset);
+}
+
+static PyObject* FindWordStart(PyObject* self, PyObject* args) {
+  PyObject* code;
+  Py_ssize_t offset;
+
+  if (!ParseOffsetArgs(args, "On:find_word_start", &code, &offset))
+    return NULL;
+
+  if (PyUnicode_Check(code)) {
+    offset = find_word_start_unicode(PyUnicode_AS_UNICODE(code), offset);
+  } else {
+    offset = find_word_start_str(PyString_AS_STRING(code), offset);
+  }
+  return PyInt_FromSsize_t(offset);
+}
+
+static PyObject* FindWordEnd(PyObject* self, PyObject* args) {
+  PyObject* code;
+  Py_ssize_t offset;
+
+  if (!ParseOffsetArgs(args, "On:find_word_end", &code, &offset))
+    return NULL;
+
+  if (PyUnicode_Check(code)) {
+    offset = find_word_end_unicode(PyUnicode_AS_UNICODE(code), offset,
+                                   PyUnicode_GET_SIZE(code));
+  } else {
+    offset = find_word_end_str(PyString_AS_STRING(code), offset,
+                               PyString_GET_SIZE(code));
+  }
+  return PyInt_FromSsize_t(offset);
+}
+
+
+static PyMethodDef kMethods[] = {
+  {"ignored_regions", IgnoredRegions, METH_VARARGS,
+   "Same as rope.base.simplify.ignored_regions."},
+  {"real_code", RealCode, METH_VARARGS,
+   "Same as rope.base.simplify.real_code."},
+  {"find_last_non_space_char", FindLastNonSpaceChar, METH_VARARGS,
+   "Same as _RealFinder._find_last_non_space_char for an offset in code."},
+  {"find_word_start", FindWordStart, METH_VARARGS,
+   "Same as _RealFinder._find_word_start for an offset in code."},
+  {"find_word_end", FindWordEnd, METH_VARARGS,
+   "Same as _RealFinder._find_word_end for an offset in code."},
+  {NULL, NULL, 0, NULL}
+};
+
+PyMODINIT_FUNC init_worderaccel(void) {
+  Py_InitModule3("_worderaccel", kMethods,
+                 "C versions of rope's source scanning functions.");
+}
@@ -0,0 +1,216 @@
+/*  pyqtc - QtCreator plugin with code completion using rope.
+    Copyright 2011 David Sansome <me@davidsansome.com>
+    Copyright 2017 Alexander Izmailov <yarolig@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* The scanners for one character type.  worderaccel.c includes this once for
+   str and once for unicode, with these defined:
+
+     CHAR          the character type
+     FUNC(name)    adds a suffix for the character type to name
+     IS_SPACE(c)   same as c.isspace() in python
+     IS_ALNUM(c)   same as c.isalnum() in python
+*/
+
+/* Same as \w in a regular expression without the UNICODE flag. */
+static int FUNC(is_re_word)(CHAR c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+static int FUNC(is_id_char)(CHAR c) {
+  return IS_ALNUM(c) || c == '_';
+}
+
+/* Returns the end of the string literal whose opening quote is at quote, or
+   -1 if it isn't terminated.  Triple quoted strings that aren't terminated
+   are tried as short strings, the same as the regular expression does. */
+static Py_ssize_t FUNC(match_string)(const CHAR* s, Py_ssize_t quote,
+                                     Py_ssize_t n) {
+  const CHAR q = s[quote];
+  Py_ssize_t i;
+
+  if (quote + 2 < n && s[quote + 1] == q && s[quote + 2] == q) {
+    i = quote + 3;
+    while (i < n) {
+      if (s[i] == '\\') {
+        if (i + 1 >= n)
+          break;
+        i += 2;
+      } else if (s[i] == q && i + 2 < n && s[i + 1] == q && s[i + 2] == q) {
+        return i + 3;
+      } else {
+        i++;
+      }
+    }
+  }
+
+  i = quote + 1;
+  while (i < n) {
+    if (s[i] == '\\') {
+      if (i + 1 >= n || s[i + 1] == '\n')
+        return -1;
+      i += 2;
+    } else if (s[i] == q) {
+      return i + 1;
+    } else if (s[i] == '\n') {
+      return -1;
+    } else {
+      i++;
+    }
+  }
+  return -1;
+}
+
+/* Returns the position of the opening quote if a string literal could start
+   at i, including any u and r prefix, otherwise -1. */
+static Py_ssize_t FUNC(string_quote)(const CHAR* s, Py_ssize_t i,
+                                     Py_ssize_t n) {
+  Py_ssize_t j = i;
+
+  if (s[i] == '"' || s[i] == '\'')
+    return i;
+
+  /* A prefix has to start at a word boundary */
+  if (i > 0 && FUNC(is_re_word)(s[i - 1]))
+    return -1;
+
+  if (s[j] == 'u' || s[j] == 'U')
+    j++;
+  if (j < n && (s[j] == 'r' || s[j] == 'R'))
+    j++;
+  if (j == i || j >= n || (s[j] != '"' && s[j] != '\''))
+    return -1;
+  return j;
+}
+
+/* Calls add(start, end, data) for each comment and string literal, in the
+   same places rope's simplify.ignored_regions finds them.  Returns -1 if add
+   failed. */
+static int FUNC(scan_ignored)(const CHAR* s, Py_ssize_t n,
+                              int (*add)(Py_ssize_t, Py_ssize_t, void*),
+                              void* data) {
+  Py_ssize_t i = 0;
+  Py_ssize_t quote, end;
+
+  while (i < n) {
+    if (s[i] == '#') {
+      end = i;
+      while (end < n && s[end] != '\n')
+        end++;
+    } else {
+      quote = FUNC(string_quote)(s, i, n);
+      end = quote < 0 ? -1 : FUNC(match_string)(s, quote, n);
+      if (end < 0) {
+        i++;
+        continue;
+      }
+    }
+
+    if (add(i, end, data) < 0)
+      return -1;
+    i = end;
+  }
+  return 0;
+}
+
+typedef struct {
+  const CHAR* source;
+  CHAR* out;
+} FUNC(RealCodeData);
+
+static int FUNC(blank_region)(Py_ssize_t start, Py_ssize_t end, void* data) {
+  FUNC(RealCodeData)* real = (FUNC(RealCodeData)*) data;
+  Py_ssize_t i;
+
+  if (real->source[start] == '#') {
+    for (i = start; i < end; ++i)
+      real->out[i] = ' ';
+  } else {
+    real->out[start] = '"';
+    for (i = start + 1; i < end - 1; ++i)
+      real->out[i] = ' ';
+    real->out[end - 1] = '"';
+  }
+  return 0;
+}
+
+/* Fills out, which has the same length as s, with rope's
+   simplify.real_code(s). */
+static void FUNC(real_code)(const CHAR* s, CHAR* out, Py_ssize_t n) {
+  FUNC(RealCodeData) data;
+  Py_ssize_t i;
+  long parens = 0;
+
+  memcpy(out, s, n * sizeof(CHAR));
+
+  /* Comments become spaces, strings become a string full of spaces */
+  data.source = s;
+  data.out = out;
+  FUNC(scan_ignored)(s, n, FUNC(blank_region), &data);
+
+  /* Implicit continuations */
+  for (i = 0; i < n; ++i) {
+    switch (out[i]) {
+      case '(': case '{': case '[':
+        parens++;
+        break;
+      case ')': case '}': case ']':
+        parens--;
+        break;
+      case '\n':
+        if (parens > 0)
+          out[i] = ' ';
+        break;
+    }
+  }
+
+  /* Explicit continuations, tabs and semicolons */
+  for (i = 0; i < n; ++i) {
+    if (out[i] == '\\' && i + 1 < n && out[i + 1] == '\n') {
+      out[i] = ' ';
+      out[i + 1] = ' ';
+      i++;
+    } else if (out[i] == '\t') {
+      out[i] = ' ';
+    } else if (out[i] == ';') {
+      out[i] = '\n';
+    }
+  }
+}
+
+static Py_ssize_t FUNC(find_last_non_space_char)(const CHAR* s,
+                                                 Py_ssize_t offset) {
+  while (offset >= 0 && IS_SPACE(s[offset])) {
+    if (s[offset] == '\n')
+      return offset;
+    offset--;
+  }
+  return offset < -1 ? -1 : offset;
+}
+
+static Py_ssize_t FUNC(find_word_start)(const CHAR* s, Py_ssize_t offset) {
+  while (offset >= 0 && FUNC(is_id_char)(s[offset]))
+    offset--;
+  return offset + 1;
+}
+
+static Py_ssize_t FUNC(find_word_end)(const CHAR* s, Py_ssize_t offset,
+                                      Py_ssize_t n) {
+  while (offset + 1 < n && FUNC(is_id_char)(s[offset + 1]))
+    offset++;
+  return offset;
+}
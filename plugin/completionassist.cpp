@@ -19,6 +19,7 @@
 
 #include "completionassist.h"
 #include "constants.h"
+#include "lexicalcompletion.h"
 #include "protostring.h"
 #include "pythonicons.h"
 #include "workerclient.h"
@@ -32,15 +33,136 @@
 #include <texteditor/codeassist/assistinterface.h>
 #include <texteditor/codeassist/assistproposalitem.h>
 #include <texteditor/codeassist/assistproposaliteminterface.h>
+#include <texteditor/codeassist/textdocumentmanipulatorinterface.h>
+#include <texteditor/completionsettings.h>
+#include <texteditor/texteditorsettings.h>
 
 
 #include <QApplication>
+#include <QSet>
 #include <QStack>
 #include <QTextDocument>
 #include <QtDebug>
 
 using namespace pyqtc;
 
+namespace {
+
+// A name from a module that isn't imported yet.  Picking it inserts the name
+// and then the import statement the worker sent with it.
+class AutoImportProposalItem : public TextEditor::AssistProposalItem {
+public:
+  AutoImportProposalItem(const QString& import_text, int import_position)
+    : import_text_(import_text),
+      import_position_(import_position)
+  {
+  }
+
+  void applyContextualContent(
+      TextEditor::TextDocumentManipulatorInterface& manipulator,
+      int basePosition) const {
+    TextEditor::AssistProposalItem::applyContextualContent(manipulator,
+                                                           basePosition);
+
+    // The import goes above the name, so inserting it afterwards doesn't
+    // move the name.
+    if (import_position_ <= basePosition) {
+      manipulator.replace(import_position_, 0, import_text_);
+    }
+  }
+
+private:
+  QString import_text_;
+  int import_position_;
+};
+
+inline bool IsAsciiUpper(char c) { return c >= 'A' && c <= 'Z'; }
+inline bool IsAsciiLower(char c) { return c >= 'a' && c <= 'z'; }
+inline bool IsAsciiDigit(char c) { return c >= '0' && c <= '9'; }
+
+inline char AsciiToUpper(char c) {
+  return IsAsciiLower(c) ? c - 'a' + 'A' : c;
+}
+inline char AsciiToLower(char c) {
+  return IsAsciiUpper(c) ? c - 'A' + 'a' : c;
+}
+
+// Returns true if name matches the typed text from pattern[pattern_pos] on,
+// starting at name[name_pos], the way Qt Creator's own completion does.
+// After the first letter an upper case letter can skip the rest of a camel
+// case hump, and a lower case letter can skip the rest of an underscore
+// separated word.  Letters whose case doesn't matter can do either.
+bool MatchesHumps(const std::string& name, int name_pos,
+                  const QByteArray& pattern, int pattern_pos,
+                  TextEditor::CaseSensitivity case_sensitivity) {
+  if (pattern_pos == pattern.size()) {
+    return true;
+  }
+
+  const int name_length = name.size();
+  const char c = pattern[pattern_pos];
+  const bool first = pattern_pos == 0;
+  const bool letter = IsAsciiUpper(c) || IsAsciiLower(c);
+  const bool exact_case =
+      case_sensitivity == TextEditor::CaseSensitive ||
+      (case_sensitivity == TextEditor::FirstLetterCaseSensitive && first);
+
+  if (first || !letter) {
+    if (name_pos >= name_length) {
+      return false;
+    }
+    const char n = name[name_pos];
+    if (n != c &&
+        (exact_case || !letter || AsciiToLower(n) != AsciiToLower(c))) {
+      return false;
+    }
+    return MatchesHumps(name, name_pos + 1, pattern, pattern_pos + 1,
+                        case_sensitivity);
+  }
+
+  // The upper case letter, after any lower case letters, digits and
+  // underscores.
+  if (!exact_case || IsAsciiUpper(c)) {
+    const char upper = AsciiToUpper(c);
+    for (int i=name_pos ; i<name_length ; ++i) {
+      const char n = name[i];
+      if (n == upper && MatchesHumps(name, i + 1, pattern, pattern_pos + 1,
+                                     case_sensitivity)) {
+        return true;
+      }
+      if (!IsAsciiLower(n) && !IsAsciiDigit(n) && n != '_') {
+        break;
+      }
+    }
+  }
+
+  // The lower case letter, either next or after the next underscore.
+  if (!exact_case || IsAsciiLower(c)) {
+    const char lower = AsciiToLower(c);
+    if (name_pos < name_length && name[name_pos] == lower &&
+        MatchesHumps(name, name_pos + 1, pattern, pattern_pos + 1,
+                     case_sensitivity)) {
+      return true;
+    }
+
+    int i = name_pos;
+    while (i < name_length && name[i] != '_' &&
+           (IsAsciiUpper(name[i]) || IsAsciiLower(name[i]) ||
+            IsAsciiDigit(name[i]))) {
+      ++i;
+    }
+    if (i + 1 < name_length && name[i] == '_' && name[i + 1] == lower &&
+        MatchesHumps(name, i + 2, pattern, pattern_pos + 1,
+                     case_sensitivity)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+} // namespace
+
 CompletionAssistProvider* m_instance = 0;
 
 CompletionAssistProvider::CompletionAssistProvider(WorkerPool<WorkerClient>* worker_pool,
@@ -70,7 +192,8 @@ bool CompletionAssistProvider::isActivationCharSequence(const QString& sequence)
 }
 
 TextEditor::IAssistProcessor* CompletionAssistProvider::createProcessor() const {
-  return new CompletionAssistProcessor(worker_pool_, icons_);
+  return new CompletionAssistProcessor(worker_pool_, icons_, &calltip_cache_,
+                                       &lexical_completion_);
 }
 
 bool CompletionAssistProvider::isAsynchronous() const {
@@ -82,15 +205,76 @@ bool CompletionAssistProvider::isContinuationChar(const QChar &c) const {
 }
 
 CompletionAssistProcessor::CompletionAssistProcessor(WorkerPool<WorkerClient>* worker_pool,
-      const PythonIcons* icons)
+      const PythonIcons* icons, CalltipCache* calltip_cache,
+      LexicalCompletion* lexical_completion)
   : worker_pool_(worker_pool),
-    icons_(icons)
+    icons_(icons),
+    calltip_cache_(calltip_cache),
+    lexical_completion_(lexical_completion)
 {
 }
 
-TextEditor::IAssistProposal* CompletionAssistProcessor::perform(const TextEditor::AssistInterface *interface) {
-  QScopedPointer<const TextEditor::AssistInterface> scoped_interface(interface);
+bool CompletionAssistProcessor::FindCallSite(
+    const TextEditor::AssistInterface* interface,
+    int* paren_position, QString* callee) {
+  // Don't look further back than this for the start of the call.
+  static const int kMaxScanLength = 4096;
+
+  // Only interesting straight after an open paren or a comma.
+  int pos = interface->position() - 1;
+  while (pos >= 0 && interface->characterAt(pos).isSpace()) {
+    --pos;
+  }
+  if (pos < 0 || (interface->characterAt(pos) != '(' &&
+                  interface->characterAt(pos) != ',')) {
+    return false;
+  }
+
+  // Walk backwards to the unmatched open paren.
+  const int stop = qMax(0, pos - kMaxScanLength);
+  int depth = 0;
+  for (pos = interface->characterAt(pos) == '(' ? pos : pos - 1 ;
+       pos >= stop ; --pos) {
+    const QChar c = interface->characterAt(pos);
+    if (c == ')' || c == ']' || c == '}') {
+      depth ++;
+    } else if (c == '[' || c == '{') {
+      if (depth == 0) {
+        return false;
+      }
+      depth --;
+    } else if (c == '(') {
+      if (depth == 0) {
+        break;
+      }
+      depth --;
+    }
+  }
+  if (pos < stop) {
+    return false;
+  }
+  *paren_position = pos;
+
+  // The callee is the dotted name just before the paren.
+  int end = pos - 1;
+  while (end >= 0 && interface->characterAt(end).isSpace()) {
+    --end;
+  }
+  int start = end;
+  while (start >= 0) {
+    const QChar c = interface->characterAt(start);
+    if (!c.isLetterOrNumber() && c != '_' && c != '.') {
+      break;
+    }
+    --start;
+  }
 
+  *callee = interface->textAt(start + 1, end - start);
+  return !callee->isEmpty();
+}
+
+bool CompletionAssistProcessor::ShouldComplete(
+    const TextEditor::AssistInterface* interface) {
   switch (interface->reason()) {
   case TextEditor::ActivationCharacter:
   case TextEditor::ExplicitlyInvoked:
@@ -102,29 +286,110 @@ TextEditor::IAssistProposal* CompletionAssistProcessor::perform(const TextEditor
     for (int i=1 ; i<=3 ; ++i) {
       QChar c(interface->characterAt(interface->position() - i));
       if (!c.isLetterOrNumber()) {
-        return NULL;
+        return false;
       }
     }
     break;
   }
 
+  return true;
+}
+
+TextEditor::IAssistProposal* CompletionAssistProcessor::immediateProposal(
+    const TextEditor::AssistInterface* interface) {
+  if (!ShouldComplete(interface)) {
+    return NULL;
+  }
+
+  // Calltips have to come from the worker.
+  int paren_position = -1;
+  QString callee;
+  if (FindCallSite(interface, &paren_position, &callee)) {
+    return NULL;
+  }
+
+  // Find the start of the name being typed.  Attributes can't be guessed
+  // from the text alone, so leave those to the worker too.
+  int start = interface->position();
+  while (start > 0) {
+    const QChar c = interface->characterAt(start - 1);
+    if (!c.isLetterOrNumber() && c != '_') {
+      break;
+    }
+    --start;
+  }
+  if (start > 0 && interface->characterAt(start - 1) == '.') {
+    return NULL;
+  }
+
+  const QString prefix = interface->textAt(start, interface->position() - start);
+
+  lexical_response_.set_insertion_position(start);
+  lexical_completion_->AddProposals(interface->textDocument(), prefix,
+                                    &lexical_response_);
+
+  if (!lexical_response_.proposal_size()) {
+    return NULL;
+  }
+
+  // Keep lexical_response_ around to merge into the worker's reply.
+  pb::CompletionResponse response(lexical_response_);
+  return CreateCompletionProposal(&response);
+}
+
+TextEditor::IAssistProposal* CompletionAssistProcessor::perform(const TextEditor::AssistInterface *interface) {
+  QScopedPointer<const TextEditor::AssistInterface> scoped_interface(interface);
+
+  if (!ShouldComplete(interface)) {
+    return NULL;
+  }
+
+  // Typing a comma inside a call we've already seen doesn't need the worker.
+  int paren_position = -1;
+  QString callee;
+  const bool in_call = FindCallSite(interface, &paren_position, &callee);
+
+  const QString text = interface->textDocument()->toPlainText();
+  uint context_hash = 0;
+
+  if (in_call) {
+    context_hash = CalltipCache::ContextHash(text, paren_position,
+                                             interface->position());
+
+    pb::Signature signature;
+    if (calltip_cache_->Lookup(interface->fileName(), paren_position, callee,
+                               context_hash, &signature)) {
+      return CreateCalltipProposal(paren_position + 1, signature);
+    }
+  }
+
   QScopedPointer<WorkerClient::ReplyType> reply(
       worker_pool_->NextHandler()->Completion(
         interface->fileName(),
-        interface->textDocument()->toPlainText(),
-        interface->position()));
+        text,
+        interface->position(),
+        constants::kMaxCompletionProposals));
   reply->WaitForFinished();
 
   if (!reply->is_successful())
     return NULL;
 
-  const pb::CompletionResponse* response = &reply->message().completion_response();
+  pb::CompletionResponse* response =
+      reply->mutable_message()->mutable_completion_response();
+
+  if (response->has_signature()) {
+    // Only cache it if the worker agrees with us about where the call starts.
+    if (in_call && response->insertion_position() == paren_position + 1) {
+      calltip_cache_->Insert(interface->fileName(), paren_position, callee,
+                             context_hash, response->signature());
+    }
 
-  if (response->has_calltip()) {
     return CreateCalltipProposal(response->insertion_position(),
-                                 ProtoStringToQString(response->calltip()));
+                                 response->signature());
   }
 
+  MergeLexicalProposals(response);
+
   if (response->proposal_size()) {
     return CreateCompletionProposal(response);
   }
@@ -132,58 +397,311 @@ TextEditor::IAssistProposal* CompletionAssistProcessor::perform(const TextEditor
   return NULL;
 }
 
-TextEditor::IAssistProposal* CompletionAssistProcessor::CreateCompletionProposal(
-    const pb::CompletionResponse* response) {
-  QList<TextEditor::AssistProposalItemInterface*> items;
+void CompletionAssistProcessor::MergeLexicalProposals(
+    pb::CompletionResponse* response) const {
+  if (!lexical_response_.proposal_size()) {
+    return;
+  }
 
+  if (!response->proposal_size()) {
+    response->set_insertion_position(lexical_response_.insertion_position());
+  } else if (response->insertion_position() !=
+             lexical_response_.insertion_position()) {
+    return;
+  }
+
+  // The worker's proposals come first, then any names it didn't know about.
+  // Names from modules that aren't imported don't count as known, since the
+  // buffer might define the same name itself.
+  QSet<QByteArray> names;
+  names.reserve(response->proposal_size());
   foreach (const pb::CompletionResponse_Proposal& proposal,
            response->proposal()) {
-    TextEditor::AssistProposalItem* item = new TextEditor::AssistProposalItem;
-    item->setText(ProtoStringToQString(proposal.name()));
-    item->setIcon(icons_->IconForCompletionProposal(proposal));
+    if (proposal.has_module()) {
+      continue;
+    }
+    names.insert(QByteArray::fromRawData(proposal.name().data(),
+                                         proposal.name().size()));
+  }
 
-    items << item;
+  foreach (const pb::CompletionResponse_Proposal& proposal,
+           lexical_response_.proposal()) {
+    const QByteArray name = QByteArray::fromRawData(proposal.name().data(),
+                                                    proposal.name().size());
+    if (!names.contains(name)) {
+      response->add_proposal()->CopyFrom(proposal);
+    }
   }
+}
+
+TextEditor::IAssistProposal* CompletionAssistProcessor::CreateCompletionProposal(
+    pb::CompletionResponse* response) {
+  const int insertion_position = response->insertion_position();
+
+  const bool incomplete = response->incomplete();
 
-  return new TextEditor::GenericProposal(
-        response->insertion_position(),
-        QList<TextEditor::AssistProposalItemInterface *>(items));
+  TextEditor::GenericProposalModelPtr model(
+        new CompletionProposalModel(response, icons_));
+  TextEditor::GenericProposal* proposal =
+      new TextEditor::GenericProposal(insertion_position, model);
+
+  // The worker left some proposals out, so filtering locally as the user
+  // types isn't enough - a fragile proposal gets requested again.
+  proposal->setFragile(incomplete);
+  return proposal;
 }
 
 TextEditor::IAssistProposal* CompletionAssistProcessor::CreateCalltipProposal(
-    int position, const QString& text) {
-  TextEditor::FunctionHintProposalModelPtr model(new FunctionHintProposalModel(text));
+    int position, const pb::Signature& signature) {
+  TextEditor::FunctionHintProposalModelPtr model(
+        new FunctionHintProposalModel(signature));
   return new TextEditor::FunctionHintProposal(position, model);
 }
 
 
-FunctionHintProposalModel::FunctionHintProposalModel(const QString& text)
-  : text_(text),
-    current_arg_(0)
+const int CalltipCache::kMaxEntries = 8;
+
+uint CalltipCache::ContextHash(const QString& text, int paren_position,
+                               int position) {
+  return qHash(text.midRef(position),
+               qHash(text.midRef(0, paren_position + 1)));
+}
+
+bool CalltipCache::Lookup(const QString& file_path, int paren_position,
+                          const QString& callee, uint context_hash,
+                          pb::Signature* signature) const {
+  QMutexLocker l(&mutex_);
+
+  foreach (const Entry& entry, entries_) {
+    if (entry.paren_position_ == paren_position &&
+        entry.context_hash_ == context_hash &&
+        entry.callee_ == callee &&
+        entry.file_path_ == file_path) {
+      signature->CopyFrom(entry.signature_);
+      return true;
+    }
+  }
+  return false;
+}
+
+void CalltipCache::Insert(const QString& file_path, int paren_position,
+                          const QString& callee, uint context_hash,
+                          const pb::Signature& signature) {
+  QMutexLocker l(&mutex_);
+
+  Entry entry;
+  entry.file_path_ = file_path;
+  entry.paren_position_ = paren_position;
+  entry.callee_ = callee;
+  entry.context_hash_ = context_hash;
+  entry.signature_.CopyFrom(signature);
+
+  entries_.prepend(entry);
+  while (entries_.count() > kMaxEntries) {
+    entries_.removeLast();
+  }
+}
+
+void CalltipCache::Clear() {
+  QMutexLocker l(&mutex_);
+  entries_.clear();
+}
+
+
+CompletionProposalModel::CompletionProposalModel(
+    pb::CompletionResponse* response, const PythonIcons* icons)
+  : icons_(icons)
 {
+  response_.Swap(response);
+
+  names_.resize(response_.proposal_size());
+  items_.fill(NULL, response_.proposal_size());
+
+  reset();
 }
 
-QString FunctionHintProposalModel::text(int index) const {
-  const int open_paren    = text_.indexOf('(');
-  if (open_paren == -1) {
-    return text_;
+CompletionProposalModel::~CompletionProposalModel() {
+  qDeleteAll(items_);
+}
+
+void CompletionProposalModel::reset() {
+  rows_.resize(response_.proposal_size());
+  for (int i=0 ; i<rows_.size() ; ++i) {
+    rows_[i] = i;
+  }
+}
+
+int CompletionProposalModel::size() const {
+  return rows_.size();
+}
+
+QString CompletionProposalModel::text(int index) const {
+  const int row = rows_[index];
+  if (names_[row].isNull()) {
+    const pb::CompletionResponse_Proposal& proposal = response_.proposal(row);
+    names_[row] = ProtoStringToQString(proposal.name());
+    if (proposal.has_module()) {
+      names_[row] += QString(" (from %1)").arg(
+            ProtoStringToQString(proposal.module()));
+    }
+  }
+  return names_[row];
+}
+
+QIcon CompletionProposalModel::icon(int index) const {
+  const pb::CompletionResponse_Proposal& proposal = ProposalAt(index);
+  return icons_->IconForCompletionProposal(
+        proposal.type(), proposal.scope(),
+        PythonIcons::IsPrivateName(proposal.name()));
+}
+
+QString CompletionProposalModel::detail(int index) const {
+  Q_UNUSED(index)
+  return QString();
+}
+
+int CompletionProposalModel::persistentId(int index) const {
+  return rows_[index];
+}
+
+void CompletionProposalModel::filter(const QString& prefix) {
+  if (prefix.isEmpty()) {
+    reset();
+    return;
+  }
+
+  // Use the same case sensitivity as Qt Creator's own completion.
+  const TextEditor::CaseSensitivity case_sensitivity =
+      TextEditor::TextEditorSettings::completionSettings().m_caseSensitivity;
+
+  // Compare against the UTF-8 names in the protobuf directly so filtering
+  // doesn't have to decode every proposal.
+  const QByteArray prefix_utf8 = prefix.toUtf8();
+
+  rows_.clear();
+  for (int i=0 ; i<response_.proposal_size() ; ++i) {
+    if (MatchesHumps(response_.proposal(i).name(), 0, prefix_utf8, 0,
+                     case_sensitivity)) {
+      rows_ << i;
+    }
   }
+}
 
-  const int close_paren   = text_.lastIndexOf(')');
-  const int last_dot      = qMax(0, text_.lastIndexOf('.', open_paren));
-  const QString args_str  = text_.mid(open_paren + 1,
-                                     close_paren - open_paren - 1);
-  const QStringList args  = args_str.split(',');
+QString CompletionProposalModel::NameAt(int index) const {
+  return ProtoStringToQString(ProposalAt(index).name());
+}
 
-  QStringList rich_args;
-  for (int i=0 ; i<args.count() ; ++i) {
-    const QString arg_trimmed = args[i].trimmed().toHtmlEscaped();
+QString CompletionProposalModel::proposalPrefix() const {
+  // Same limits as GenericProposalModel: only expand a short list.
+  if (size() < 2 || size() >= 20) {
+    return QString();
+  }
 
-    if (current_arg_ == i) {
-      rich_args << QString("<b>%1</b>").arg(arg_trimmed);
+  QString common = NameAt(0);
+  for (int i=1 ; i<size() && !common.isEmpty() ; ++i) {
+    const QString name = NameAt(i);
+    int length = 0;
+    while (length < common.length() && length < name.length() &&
+           common[length] == name[length]) {
+      ++length;
+    }
+    common.truncate(length);
+  }
+  return common;
+}
+
+bool CompletionProposalModel::keepPerfectMatch(
+    TextEditor::AssistReason reason) const {
+  // Keep the list open when it was asked for, even if what's been typed is
+  // already complete.
+  return reason != TextEditor::IdleEditor;
+}
+
+bool CompletionProposalModel::isPerfectMatch(const QString& prefix) const {
+  if (prefix.isEmpty()) {
+    return false;
+  }
+
+  const TextEditor::CaseSensitivity case_sensitivity =
+      TextEditor::TextEditorSettings::completionSettings().m_caseSensitivity;
+
+  for (int i=0 ; i<size() ; ++i) {
+    const QString name = NameAt(i);
+    if (name.isEmpty()) {
+      continue;
+    }
+
+    switch (case_sensitivity) {
+    case TextEditor::CaseSensitive:
+      if (name == prefix) {
+        return true;
+      }
+      break;
+
+    case TextEditor::CaseInsensitive:
+      if (name.compare(prefix, Qt::CaseInsensitive) == 0) {
+        return true;
+      }
+      break;
+
+    case TextEditor::FirstLetterCaseSensitive:
+      if (name[0] == prefix[0] &&
+          name.midRef(1).compare(prefix.midRef(1), Qt::CaseInsensitive) == 0) {
+        return true;
+      }
+      break;
+    }
+  }
+  return false;
+}
+
+TextEditor::AssistProposalItemInterface* CompletionProposalModel::proposalItem(
+    int index) const {
+  const int row = rows_[index];
+  if (!items_[row]) {
+    const pb::CompletionResponse_Proposal& proposal = ProposalAt(index);
+    TextEditor::AssistProposalItem* item;
+    if (proposal.has_import_text()) {
+      item = new AutoImportProposalItem(
+            ProtoStringToQString(proposal.import_text()),
+            proposal.import_position());
     } else {
-      rich_args << arg_trimmed;
+      item = new TextEditor::AssistProposalItem;
     }
+    item->setText(ProtoStringToQString(proposal.name()));
+    item->setIcon(icon(index));
+    items_[row] = item;
+  }
+  return items_[row];
+}
+
+
+FunctionHintProposalModel::FunctionHintProposalModel(
+    const pb::Signature& signature)
+  : current_arg_(0)
+{
+  // The scope ends with a dot, which is shown in the function name's color.
+  QString scope = ProtoStringToQString(signature.scope());
+  QString name = ProtoStringToQString(signature.name());
+  if (scope.endsWith('.')) {
+    scope.chop(1);
+    name.prepend('.');
+  }
+
+  scope_ = scope.toHtmlEscaped();
+  name_ = name.toHtmlEscaped();
+
+  for (int i=0 ; i<signature.parameter_size() ; ++i) {
+    parameters_ << ProtoStringToQString(signature.parameter(i)).toHtmlEscaped();
+  }
+}
+
+QString FunctionHintProposalModel::text(int index) const {
+  Q_UNUSED(index)
+
+  QStringList rich_args = parameters_;
+  if (current_arg_ >= 0 && current_arg_ < rich_args.count()) {
+    rich_args[current_arg_] = QString("<b>%1</b>").arg(rich_args[current_arg_]);
   }
 
   // Pick a color between the tooltip background and foreground for the module
@@ -195,8 +713,8 @@ QString FunctionHintProposalModel::text(int index) const {
         QString::number(foreground.red()),
         QString::number(foreground.green()),
         QString::number(foreground.blue()),
-        QString(text_.left(last_dot).toHtmlEscaped()),
-        QString(text_.mid(last_dot, open_paren - last_dot).toHtmlEscaped()),
+        scope_,
+        name_,
         rich_args.join(", "));
 }
 
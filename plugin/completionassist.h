@@ -24,12 +24,20 @@
 #include <texteditor/codeassist/ifunctionhintproposalmodel.h>
 #include <texteditor/codeassist/genericproposalmodel.h>
 
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+
 #include "config.h"
+#include "lexicalcompletion.h"
 #include "rpc.pb.h"
 #include "workerclient.h"
 #include "workerpool.h"
 
 namespace TextEditor {
+  class AssistProposalItem;
   class IAssistInterface;
 }
 
@@ -37,6 +45,47 @@ namespace pyqtc {
 
 class PythonIcons;
 
+// Remembers the signatures of the last few call sites so that typing a comma
+// inside a call can show the calltip again without asking the worker.  Entries
+// are keyed by the position of the open paren, the text of the callee and a
+// hash of the rest of the document, so they stop matching as soon as anything
+// but the call's arguments is edited.  Everything is forgotten when a symbol
+// index is updated, since the callee might be defined in another file.
+class CalltipCache : public QObject {
+  Q_OBJECT
+
+public:
+  // Hashes everything in text up to the paren and from position on.  Typing
+  // more arguments at position doesn't change it.
+  static uint ContextHash(const QString& text, int paren_position,
+                          int position);
+
+  bool Lookup(const QString& file_path, int paren_position,
+              const QString& callee, uint context_hash,
+              pb::Signature* signature) const;
+  void Insert(const QString& file_path, int paren_position,
+              const QString& callee, uint context_hash,
+              const pb::Signature& signature);
+
+public slots:
+  void Clear();
+
+private:
+  static const int kMaxEntries;
+
+  struct Entry {
+    QString file_path_;
+    int paren_position_;
+    QString callee_;
+    uint context_hash_;
+    pb::Signature signature_;
+  };
+
+  mutable QMutex mutex_;
+  QList<Entry> entries_;
+};
+
+
 class CompletionAssistProvider : public TextEditor::CompletionAssistProvider {
 public:
   CompletionAssistProvider(WorkerPool<WorkerClient>* worker_pool,
@@ -48,10 +97,16 @@ public:
   TextEditor::IAssistProcessor* createProcessor() const;
 
   static CompletionAssistProvider* instance();
+
+  CalltipCache* calltip_cache() const { return &calltip_cache_; }
+
 private:
   WorkerPool<WorkerClient>* worker_pool_;
   const PythonIcons* icons_;
 
+  mutable CalltipCache calltip_cache_;
+  mutable LexicalCompletion lexical_completion_;
+
   // IAssistProvider interface
 public:
   bool isAsynchronous() const;
@@ -64,24 +119,90 @@ public:
 class CompletionAssistProcessor : public TextEditor::IAssistProcessor {
 public:
   CompletionAssistProcessor(WorkerPool<WorkerClient>* worker_pool,
-                            const PythonIcons* icons);
-
+                            const PythonIcons* icons,
+                            CalltipCache* calltip_cache,
+                            LexicalCompletion* lexical_completion);
+
+  // Called in the GUI thread before perform().  Proposes names from the
+  // document, keywords and builtins while the worker is busy.
+  TextEditor::IAssistProposal* immediateProposal(
+      const TextEditor::AssistInterface* interface);
   TextEditor::IAssistProposal* perform(const TextEditor::AssistInterface* interface);
 private:
+  static bool ShouldComplete(const TextEditor::AssistInterface* interface);
+  static bool FindCallSite(const TextEditor::AssistInterface* interface,
+                           int* paren_position, QString* callee);
+
   TextEditor::IAssistProposal* CreateCalltipProposal(
-      int position, const QString& text);
+      int position, const pb::Signature& signature);
   TextEditor::IAssistProposal* CreateCompletionProposal(
-      const pb::CompletionResponse* response);
+      pb::CompletionResponse* response);
+  void MergeLexicalProposals(pb::CompletionResponse* response) const;
 
 private:
   WorkerPool<WorkerClient>* worker_pool_;
   const PythonIcons* icons_;
+  CalltipCache* calltip_cache_;
+  LexicalCompletion* lexical_completion_;
+
+  // Filled in by immediateProposal().
+  pb::CompletionResponse lexical_response_;
+};
+
+
+// Keeps the worker's CompletionResponse and only decodes names and creates
+// proposal items for the rows that the proposal widget actually asks for.
+class CompletionProposalModel : public TextEditor::GenericProposalModel {
+public:
+  // Takes the contents of response, leaving it empty.
+  CompletionProposalModel(pb::CompletionResponse* response,
+                          const PythonIcons* icons);
+  ~CompletionProposalModel();
+
+  void reset();
+  int size() const;
+  QString text(int index) const;
+  QIcon icon(int index) const;
+  QString detail(int index) const;
+  int persistentId(int index) const;
+  bool containsDuplicates() const { return false; }
+  void removeDuplicates() {}
+  void filter(const QString& prefix);
+  bool isSortable(const QString&) const { return false; }
+  void sort(const QString&) {}
+  // These work on the proposals' names.  GenericProposalModel's own
+  // proposalPrefix() reads its list of items, which is never filled in.
+  bool supportsPrefixExpansion() const { return true; }
+  QString proposalPrefix() const;
+  bool keepPerfectMatch(TextEditor::AssistReason reason) const;
+  bool isPerfectMatch(const QString& prefix) const;
+  TextEditor::AssistProposalItemInterface* proposalItem(int index) const;
+
+private:
+  const pb::CompletionResponse_Proposal& ProposalAt(int index) const {
+    return response_.proposal(rows_[index]);
+  }
+  // The proposal's name, without the module shown by text().
+  QString NameAt(int index) const;
+
+private:
+  pb::CompletionResponse response_;
+  const PythonIcons* icons_;
+
+  // Indices into response_.proposal() that match the current filter.
+  QVector<int> rows_;
+
+  // Filled in on demand, indexed the same as response_.proposal().  names_
+  // holds the text shown in the list, which for names that have to be
+  // imported includes the module.
+  mutable QVector<QString> names_;
+  mutable QVector<TextEditor::AssistProposalItem*> items_;
 };
 
 
 class FunctionHintProposalModel : public TextEditor::IFunctionHintProposalModel {
 public:
-  FunctionHintProposalModel(const QString& text);
+  FunctionHintProposalModel(const pb::Signature& signature);
 
   void reset() {}
   int size() const { return 1; }
@@ -89,7 +210,11 @@ public:
   int activeArgument(const QString& prefix) const;
 
 private:
-  QString text_;
+  // Already HTML escaped.
+  QString scope_;
+  QString name_;
+  QStringList parameters_;
+
   mutable int current_arg_;
 };
 
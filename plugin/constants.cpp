@@ -30,5 +30,9 @@ const char* kEditorId = "pyqtc.PythonEditor";
 const char* kMenuContext = "pyqtc.ContextMenu";
 const char* kJumpToDefinitionId = "pyqtc.JumpToDefinition";
 
+const char* kIndexingTaskId = "pyqtc.Indexing";
+
+const int kMaxCompletionProposals = 200;
+
 }
 }
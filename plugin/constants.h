@@ -30,6 +30,10 @@ extern const char* kEditorId;
 extern const char* kMenuContext;
 extern const char* kJumpToDefinitionId;
 
+extern const char* kIndexingTaskId;
+
+extern const int kMaxCompletionProposals;
+
 }
 }
 
@@ -29,31 +29,105 @@
 
 using namespace pyqtc;
 
-HoverHandler::HoverHandler(WorkerPool<WorkerClient>* worker_pool)
+const int HoverHandler::kDebounceMsec = 200;
+
+HoverHandler::HoverHandler(WorkerPool<WorkerClient>* worker_pool,
+                           SymbolInfoCache* symbol_info_cache)
     : worker_pool_(worker_pool),
+      symbol_info_cache_(symbol_info_cache),
+      has_cached_text_(false),
       current_reply_(NULL),
+      current_worker_(NULL),
       current_editor_(NULL)
 {
+    debounce_timer_.setSingleShot(true);
+    debounce_timer_.setInterval(kDebounceMsec);
+    connect(&debounce_timer_, SIGNAL(timeout()), SLOT(SendPendingRequest()));
 }
 
 void HoverHandler::identifyMatch(TextEditor::TextEditorWidget *editorWidget, int pos) {
-    current_reply_ = worker_pool_->NextHandler()->Tooltip(
-                editorWidget->textDocument()->filePath().toString(),
-                editorWidget->textDocument()->plainText(),
-                pos);
+    has_cached_text_ = false;
+    hovered_span_ = SymbolSpan::At(editorWidget, pos);
+
+    if (!hovered_span_.IsValid()) {
+        pending_span_ = SymbolSpan();
+        debounce_timer_.stop();
+        return;
+    }
+
+    pb::SymbolInfoResponse info;
+    if (symbol_info_cache_->Find(hovered_span_, &info)) {
+        cached_text_ = ProtoStringToQString(info.rich_text());
+        has_cached_text_ = true;
+        pending_span_ = SymbolSpan();
+        debounce_timer_.stop();
+        return;
+    }
+
+    // Still on the identifier we're already waiting for.
+    if (current_reply_ && current_span_ == hovered_span_) {
+        pending_span_ = SymbolSpan();
+        return;
+    }
+
+    pending_span_ = hovered_span_;
+    debounce_timer_.start();
+}
+
+void HoverHandler::SendPendingRequest() {
+    if (!pending_span_.IsCurrent() || !pending_span_.editor_) {
+        pending_span_ = SymbolSpan();
+        return;
+    }
+
+    // The mouse has moved on from the identifier we're waiting for.  The
+    // worker drops that request if it hasn't started it, and its reply is
+    // ignored either way.
+    if (current_reply_) {
+        WorkerClient::ReplyType* cancel =
+                current_worker_->Cancel(current_reply_->id());
+        connect(cancel, SIGNAL(Finished(bool)), cancel, SLOT(deleteLater()));
+        current_reply_ = NULL;
+    }
+
+    TextEditor::TextEditorWidget* editor = pending_span_.editor_.data();
+
+    current_span_ = pending_span_;
+    pending_span_ = SymbolSpan();
+
+    current_worker_ = worker_pool_->NextHandler();
+    current_reply_ = current_worker_->SymbolInfo(
+                editor->textDocument()->filePath().toString(),
+                editor->textDocument()->plainText(),
+                current_span_.position_);
 
     NewClosure(current_reply_, SIGNAL(Finished(bool)),
-               this, SLOT(TooltipResponse(WorkerClient::ReplyType*)),
+               this, SLOT(SymbolInfoResponse(WorkerClient::ReplyType*)),
                current_reply_);
 }
 
-void HoverHandler::TooltipResponse(WorkerClient::ReplyType* reply) {
+void HoverHandler::SymbolInfoResponse(WorkerClient::ReplyType* reply) {
     reply->deleteLater();
 
-    if (!reply->is_successful() || reply != current_reply_)
+    if (reply != current_reply_)
         return;
+    current_reply_ = NULL;
 
-    const QString& text = ProtoStringToQString(reply->message().tooltip_response().rich_text());
+    if (reply->is_successful()) {
+        const pb::SymbolInfoResponse& info = reply->message().symbol_info_response();
+        symbol_info_cache_->Insert(current_span_, info);
+
+        // Only show it if the mouse is still over the same identifier.
+        if (current_span_ == hovered_span_)
+            ShowTooltip(ProtoStringToQString(info.rich_text()));
+    }
+
+    // The mouse moved somewhere else while we were waiting.
+    if (pending_span_.IsValid() && !debounce_timer_.isActive())
+        SendPendingRequest();
+}
+
+void HoverHandler::ShowTooltip(const QString& text) {
     if (current_editor_) {
         if (text.isEmpty()) {
             Utils::ToolTip::instance()->hide();
@@ -64,12 +138,15 @@ void HoverHandler::TooltipResponse(WorkerClient::ReplyType* reply) {
                         current_editor_);
         }
     }
-
-    current_reply_ = NULL;
 }
 
 void HoverHandler::operateTooltip(TextEditor::TextEditorWidget *editor,
                                   const QPoint& point) {
     current_editor_ = editor;
     current_point_ = point;
+
+    if (has_cached_text_) {
+        has_cached_text_ = false;
+        ShowTooltip(cached_text_);
+    }
 }
@@ -17,6 +17,7 @@
 */
 #pragma once
 
+#include "symbolinfocache.h"
 #include "workerclient.h"
 #include "workerpool.h"
 
@@ -24,6 +25,7 @@
 #include <texteditor/basehoverhandler.h>
 
 #include <QPoint>
+#include <QTimer>
 
 namespace pyqtc {
 
@@ -31,19 +33,38 @@ class HoverHandler : public QObject, public TextEditor::BaseHoverHandler {
   Q_OBJECT
 
 public:
-  HoverHandler(WorkerPool<WorkerClient>* worker_pool);
+  HoverHandler(WorkerPool<WorkerClient>* worker_pool,
+               SymbolInfoCache* symbol_info_cache);
 
 private slots:
-  void TooltipResponse(WorkerClient::ReplyType* reply);
+  void SendPendingRequest();
+  void SymbolInfoResponse(WorkerClient::ReplyType* reply);
 
 private:
+  static const int kDebounceMsec;
+
   void identifyMatch(TextEditor::TextEditorWidget *editorWidget, int pos);
   void operateTooltip(TextEditor::TextEditorWidget* editor, const QPoint& point);
 
+  void ShowTooltip(const QString& text);
+
 private:
   WorkerPool<WorkerClient>* worker_pool_;
+  SymbolInfoCache* symbol_info_cache_;
+
+  // Requests are only sent once the mouse has stopped on an identifier for
+  // kDebounceMsec.  Sending one cancels the previous one if it's still in
+  // flight.
+  QTimer debounce_timer_;
+  SymbolSpan hovered_span_;
+  SymbolSpan pending_span_;
+  SymbolSpan current_span_;
+
+  bool has_cached_text_;
+  QString cached_text_;
 
   WorkerClient::ReplyType* current_reply_;
+  WorkerClient* current_worker_;
   TextEditor::TextEditorWidget* current_editor_;
   QPoint current_point_;
 };
@@ -0,0 +1,318 @@
+/*  pyqtc - QtCreator plugin with code completion using rope.
+    Copyright 2011 David Sansome <me@davidsansome.com>
+    Copyright 2017 Alexander Izmailov <yarolig@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "lexicalcompletion.h"
+#include "protostring.h"
+
+#include <QSet>
+#include <QTextBlock>
+#include <QTextDocument>
+
+using namespace pyqtc;
+
+namespace {
+
+const char* kKeywords[] = {
+  "and", "as", "assert", "break", "class", "continue", "def", "del", "elif",
+  "else", "except", "exec", "finally", "for", "from", "global", "if",
+  "import", "in", "is", "lambda", "not", "or", "pass", "print", "raise",
+  "return", "try", "while", "with", "yield",
+  NULL
+};
+
+const char* kBuiltinClasses[] = {
+  "basestring", "bool", "bytearray", "classmethod", "complex", "dict",
+  "enumerate", "file", "float", "frozenset", "int", "list", "long", "object",
+  "property", "reversed", "set", "slice", "staticmethod", "str", "super",
+  "tuple", "type", "unicode", "xrange",
+  NULL
+};
+
+const char* kBuiltinFunctions[] = {
+  "abs", "all", "any", "bin", "callable", "chr", "cmp", "compile", "delattr",
+  "dir", "divmod", "eval", "execfile", "filter", "format", "getattr",
+  "globals", "hasattr", "hash", "help", "hex", "id", "input", "isinstance",
+  "issubclass", "iter", "len", "locals", "map", "max", "min", "next", "oct",
+  "open", "ord", "pow", "range", "raw_input", "reduce", "reload", "repr",
+  "round", "setattr", "sorted", "sum", "unichr", "vars", "zip",
+  NULL
+};
+
+const char* kBuiltinConstants[] = {
+  "False", "None", "True",
+  NULL
+};
+
+void AddNames(const char** names, const QString& prefix,
+              pb::CompletionResponse_Proposal_Type type,
+              pb::CompletionResponse_Proposal_Scope scope,
+              QSet<QString>* seen, pb::CompletionResponse* response) {
+  for (const char** name = names ; *name ; ++name) {
+    const QString str = QLatin1String(*name);
+    if (!str.startsWith(prefix, Qt::CaseInsensitive) || seen->contains(str)) {
+      continue;
+    }
+    seen->insert(str);
+
+    pb::CompletionResponse_Proposal* proposal = response->add_proposal();
+    proposal->set_name(*name);
+    proposal->set_type(type);
+    proposal->set_scope(scope);
+  }
+}
+
+// Moves *i past the end of a string closed by three quote characters.
+// Returns false if the string doesn't end in text.
+bool SkipTripleQuotedString(const QString& text, QChar quote, int* i) {
+  const QString end(3, quote);
+  for ( ; *i < text.length() ; ++*i) {
+    if (text[*i] == '\\') {
+      ++*i;
+    } else if (text.midRef(*i, 3) == end) {
+      *i += 3;
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace
+
+LexicalCompletion::LexicalCompletion(QObject* parent)
+  : QObject(parent)
+{
+}
+
+void LexicalCompletion::AddProposals(QTextDocument* document,
+                                     const QString& prefix,
+                                     pb::CompletionResponse* response) {
+  const DocumentTokens* tokens = Tokens(document);
+
+  // Don't propose the name that's being typed.
+  QSet<QString> seen;
+  seen.insert(prefix);
+
+  QStringList identifiers;
+
+  const QString lower_prefix = prefix.toLower();
+  for (QMap<QString, QHash<QString, int> >::const_iterator it =
+           tokens->identifiers_.lowerBound(lower_prefix) ;
+       it != tokens->identifiers_.constEnd() &&
+           it.key().startsWith(lower_prefix) ;
+       ++it) {
+    foreach (const QString& identifier, it->keys()) {
+      if (!seen.contains(identifier)) {
+        seen.insert(identifier);
+        identifiers << identifier;
+      }
+    }
+  }
+
+  identifiers.sort();
+  foreach (const QString& identifier, identifiers) {
+    response->add_proposal()->set_name(QStringToProtoString(identifier));
+  }
+
+  AddNames(kKeywords, prefix,
+           pb::CompletionResponse_Proposal_Type_INSTANCE,
+           pb::CompletionResponse_Proposal_Scope_KEYWORD, &seen, response);
+  AddNames(kBuiltinClasses, prefix,
+           pb::CompletionResponse_Proposal_Type_CLASS,
+           pb::CompletionResponse_Proposal_Scope_BUILTIN, &seen, response);
+  AddNames(kBuiltinFunctions, prefix,
+           pb::CompletionResponse_Proposal_Type_FUNCTION,
+           pb::CompletionResponse_Proposal_Scope_BUILTIN, &seen, response);
+  AddNames(kBuiltinConstants, prefix,
+           pb::CompletionResponse_Proposal_Type_INSTANCE,
+           pb::CompletionResponse_Proposal_Scope_BUILTIN, &seen, response);
+}
+
+LexicalCompletion::DocumentTokens* LexicalCompletion::Tokens(
+    QTextDocument* document) {
+  QHash<QTextDocument*, DocumentTokens>::iterator it =
+      documents_.find(document);
+  if (it != documents_.end()) {
+    return &it.value();
+  }
+
+  connect(document, SIGNAL(contentsChange(int,int,int)),
+          SLOT(DocumentContentsChanged(int,int,int)));
+  connect(document, SIGNAL(destroyed(QObject*)),
+          SLOT(DocumentDestroyed(QObject*)));
+
+  DocumentTokens* tokens = &documents_[document];
+  tokens->blocks_.resize(document->blockCount());
+  TokenizeBlocks(document, 0, document->blockCount(), tokens);
+  return tokens;
+}
+
+void LexicalCompletion::DocumentContentsChanged(int position,
+                                                int chars_removed,
+                                                int chars_added) {
+  Q_UNUSED(chars_removed)
+
+  QTextDocument* document = static_cast<QTextDocument*>(sender());
+  DocumentTokens* tokens = &documents_[document];
+
+  // The changed blocks in the document now, and how many there were before.
+  QTextBlock first_block = document->findBlock(position);
+  QTextBlock last_block = document->findBlock(position + chars_added);
+  if (!first_block.isValid()) {
+    first_block = document->lastBlock();
+  }
+  if (!last_block.isValid()) {
+    last_block = document->lastBlock();
+  }
+
+  const int first = first_block.blockNumber();
+  const int count = last_block.blockNumber() - first + 1;
+  const int old_count =
+      count - (document->blockCount() - tokens->blocks_.count());
+
+  if (old_count < 1 || first + old_count > tokens->blocks_.count()) {
+    // Lost track somehow, start again.
+    tokens->blocks_.clear();
+    tokens->identifiers_.clear();
+    tokens->blocks_.resize(document->blockCount());
+    TokenizeBlocks(document, 0, document->blockCount(), tokens);
+    return;
+  }
+
+  // Line up the old blocks with the new ones.  The changed blocks are
+  // tokenized again anyway, so it doesn't matter which ones are removed.
+  if (old_count > count) {
+    for (int i=first + count ; i<first + old_count ; ++i) {
+      CountIdentifiers(tokens->blocks_[i].identifiers_, -1, tokens);
+    }
+    tokens->blocks_.remove(first + count, old_count - count);
+  } else if (count > old_count) {
+    tokens->blocks_.insert(first + old_count, count - old_count,
+                           BlockTokens());
+  }
+
+  TokenizeBlocks(document, first, count, tokens);
+}
+
+void LexicalCompletion::TokenizeBlocks(QTextDocument* document, int first,
+                                       int count, DocumentTokens* tokens) {
+  StringState state =
+      first > 0 ? tokens->blocks_[first - 1].end_state_ : kNoString;
+
+  QTextBlock block = document->findBlockByNumber(first);
+  for (int i=first ; block.isValid() && i<tokens->blocks_.count() ;
+       ++i, block = block.next()) {
+    BlockTokens& block_tokens = tokens->blocks_[i];
+    const bool in_range = i < first + count;
+
+    if (block_tokens.start_state_ == state &&
+        (!in_range || block_tokens.revision_ == block.revision())) {
+      if (!in_range) {
+        // Nothing after this is affected.
+        break;
+      }
+      state = block_tokens.end_state_;
+      continue;
+    }
+
+    CountIdentifiers(block_tokens.identifiers_, -1, tokens);
+    block_tokens.identifiers_.clear();
+
+    block_tokens.revision_ = block.revision();
+    block_tokens.start_state_ = state;
+    block_tokens.end_state_ =
+        Tokenize(block.text(), state, &block_tokens.identifiers_);
+    state = block_tokens.end_state_;
+
+    CountIdentifiers(block_tokens.identifiers_, 1, tokens);
+  }
+}
+
+void LexicalCompletion::CountIdentifiers(const QStringList& identifiers,
+                                         int delta, DocumentTokens* tokens) {
+  foreach (const QString& identifier, identifiers) {
+    const QString key = identifier.toLower();
+    QHash<QString, int>& counts = tokens->identifiers_[key];
+
+    int& count = counts[identifier];
+    count += delta;
+    if (count <= 0) {
+      counts.remove(identifier);
+      if (counts.isEmpty()) {
+        tokens->identifiers_.remove(key);
+      }
+    }
+  }
+}
+
+LexicalCompletion::StringState LexicalCompletion::Tokenize(
+    const QString& text, StringState state, QStringList* identifiers) {
+  const int length = text.length();
+  int i = 0;
+
+  if (state != kNoString &&
+      !SkipTripleQuotedString(text, state == kDoubleQuotedString ? '"' : '\'',
+                              &i)) {
+    return state;
+  }
+
+  StringState end_state = kNoString;
+
+  while (i < length) {
+    const QChar c = text[i];
+
+    if (c == '#') {
+      // The rest of the line is a comment.
+      break;
+    } else if ((c == '"' || c == '\'') && text.midRef(i, 3) == QString(3, c)) {
+      // Triple quoted strings can carry on into the following blocks.
+      i += 3;
+      if (!SkipTripleQuotedString(text, c, &i)) {
+        end_state = c == '"' ? kDoubleQuotedString : kSingleQuotedString;
+        break;
+      }
+    } else if (c == '"' || c == '\'') {
+      // Skip over the string.
+      for (++i ; i < length && text[i] != c ; ++i) {
+        if (text[i] == '\\') {
+          ++i;
+        }
+      }
+      ++i;
+    } else if (c.isDigit()) {
+      // Don't pick up the exponent or suffix of a number.
+      while (i < length && (text[i].isLetterOrNumber() || text[i] == '.')) {
+        ++i;
+      }
+    } else if (c.isLetter() || c == '_') {
+      const int start = i;
+      while (i < length && (text[i].isLetterOrNumber() || text[i] == '_')) {
+        ++i;
+      }
+      identifiers->append(text.mid(start, i - start));
+    } else {
+      ++i;
+    }
+  }
+
+  identifiers->removeDuplicates();
+  return end_state;
+}
+
+void LexicalCompletion::DocumentDestroyed(QObject* document) {
+  documents_.remove(static_cast<QTextDocument*>(document));
+}
@@ -0,0 +1,94 @@
+/*  pyqtc - QtCreator plugin with code completion using rope.
+    Copyright 2011 David Sansome <me@davidsansome.com>
+    Copyright 2017 Alexander Izmailov <yarolig@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "rpc.pb.h"
+
+#include <QHash>
+#include <QMap>
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+
+class QTextDocument;
+
+namespace pyqtc {
+
+// Collects the identifiers in open documents so that completion can show
+// something immediately, before the worker replies.  Only the blocks touched
+// by each change to a document are tokenized again, and the identifiers are
+// kept sorted so a completion only looks at the ones it proposes.  Must only
+// be used from the GUI thread.
+class LexicalCompletion : public QObject {
+  Q_OBJECT
+
+public:
+  LexicalCompletion(QObject* parent = 0);
+
+  // Adds a proposal to response for every identifier in document, and every
+  // Python keyword and builtin, that starts with prefix.
+  void AddProposals(QTextDocument* document, const QString& prefix,
+                    pb::CompletionResponse* response);
+
+private slots:
+  void DocumentContentsChanged(int position, int chars_removed, int chars_added);
+  void DocumentDestroyed(QObject* document);
+
+private:
+  // Whether a block starts or ends inside a triple quoted string.
+  enum StringState {
+    kNoString,
+    kSingleQuotedString,
+    kDoubleQuotedString
+  };
+
+  struct BlockTokens {
+    BlockTokens()
+      : revision_(-1), start_state_(kNoString), end_state_(kNoString) {}
+
+    int revision_;
+    StringState start_state_;
+    StringState end_state_;
+    QStringList identifiers_;
+  };
+
+  struct DocumentTokens {
+    // Indexed by block number.  The QTextBlockUserData and user state of each
+    // block already belong to the editor.
+    QVector<BlockTokens> blocks_;
+
+    // Lowercase identifier -> identifier -> number of blocks it's in.
+    QMap<QString, QHash<QString, int> > identifiers_;
+  };
+
+  DocumentTokens* Tokens(QTextDocument* document);
+
+  // Tokenizes the blocks from first to first + count - 1 if they changed,
+  // then the ones after them until one starts in the same string state as it
+  // did before.
+  static void TokenizeBlocks(QTextDocument* document, int first, int count,
+                             DocumentTokens* tokens);
+  static void CountIdentifiers(const QStringList& identifiers, int delta,
+                               DocumentTokens* tokens);
+  static StringState Tokenize(const QString& text, StringState state,
+                              QStringList* identifiers);
+
+  QHash<QTextDocument*, DocumentTokens> documents_;
+};
+
+} // namespace pyqtc
@@ -81,6 +81,10 @@ public:
 
   const MessageType& message() const { return message_; }
 
+  // Lets the caller Swap() parts of a finished reply out instead of copying
+  // them.
+  MessageType* mutable_message() { return &message_; }
+
   void SetReply(const MessageType& message);
 
 private:
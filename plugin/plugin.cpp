@@ -60,7 +60,9 @@ inline void InitResources() {
 
 Plugin::Plugin()
   : worker_pool_(new WorkerPool<WorkerClient>(this)),
-    icons_(new PythonIcons)
+    icons_(new PythonIcons),
+    symbol_info_cache_(new SymbolInfoCache(this)),
+    symbol_tables_(new SymbolTables)
 {
   InitResources();
 
@@ -79,6 +81,7 @@ Plugin::~Plugin() {
   if (pef) {delete pef;pef=nullptr;}
   if (cap) {delete cap;cap=nullptr;}
   if (p) {delete p;p=nullptr;}
+  delete symbol_tables_;
 }
 
 bool Plugin::initialize(const QStringList& arguments, QString* errorString) {
@@ -88,12 +91,15 @@ bool Plugin::initialize(const QStringList& arguments, QString* errorString) {
   qDebug() << "pyqtc Plugin::initialize";
 
   // Utils::addMimeTypes(QLatin1String(":/pythoneditor/PythonEditor.mimetypes.xml"));
-  p = new Projects(worker_pool_);
+  p = new Projects(worker_pool_, symbol_tables_);
   cap = new CompletionAssistProvider(worker_pool_, icons_);
-  pef = new PythonEditorFactory(0, worker_pool_);
-  pcf = new PythonClassFilter(worker_pool_, icons_);
-  pff = new PythonFunctionFilter(worker_pool_, icons_);
-  pcdf = new PythonCurrentDocumentFilter(worker_pool_, icons_);
+  pef = new PythonEditorFactory(0, worker_pool_, symbol_info_cache_);
+  pcf = new PythonClassFilter(worker_pool_, symbol_tables_, icons_);
+  pff = new PythonFunctionFilter(worker_pool_, symbol_tables_, icons_);
+  pcdf = new PythonCurrentDocumentFilter(worker_pool_, symbol_tables_, icons_);
+
+  connect(p, SIGNAL(SymbolIndexUpdated()), cap->calltip_cache(), SLOT(Clear()));
+  connect(p, SIGNAL(SymbolIndexUpdated()), symbol_info_cache_, SLOT(Clear()));
 
   Core::Context context(constants::kEditorId);
   Core::ActionContainer* menu = Core::ActionManager::createMenu(constants::kMenuContext);
@@ -125,8 +131,17 @@ void Plugin::JumpToDefinition() {
     return;
   }
 
+  // The definition might already be known from hovering over the symbol.
+  jump_span_ = SymbolSpan::At(editor, editor->position());
+
+  pb::SymbolInfoResponse info;
+  if (symbol_info_cache_->Find(jump_span_, &info)) {
+    JumpTo(editor, info);
+    return;
+  }
+
   WorkerClient::ReplyType* reply =
-      worker_pool_->NextHandler()->DefinitionLocation(
+      worker_pool_->NextHandler()->SymbolInfo(
         editor->textDocument()->filePath().toString(),
         editor->textDocument()->plainText(),
         editor->position());
@@ -143,6 +158,9 @@ void Plugin::JumpToDefinitionFinished(WorkerClient::ReplyType* reply) {
     return;
   }
 
+  const pb::SymbolInfoResponse& info = reply->message().symbol_info_response();
+  symbol_info_cache_->Insert(jump_span_, info);
+
   Core::EditorManager* em = Core::EditorManager::instance();
   TextEditor::TextEditorWidget* editor = qobject_cast<TextEditor::TextEditorWidget*>(
         em->currentEditor()->widget());
@@ -150,15 +168,16 @@ void Plugin::JumpToDefinitionFinished(WorkerClient::ReplyType* reply) {
     return;
   }
 
-  const pb::DefinitionLocationResponse& response =
-      reply->message().definition_location_response();
+  JumpTo(editor, info);
+}
 
-  if (response.has_line()) {
-    if (response.has_file_path()) {
-      Core::EditorManager::openEditorAt(ProtoStringToQString(response.file_path()), response.line());
+void Plugin::JumpTo(TextEditor::TextEditorWidget* editor,
+                    const pb::SymbolInfoResponse& info) {
+  if (info.has_line()) {
+    if (info.has_file_path()) {
+      Core::EditorManager::openEditorAt(ProtoStringToQString(info.file_path()), info.line());
     } else {
-      editor->gotoLine(response.line());
+      editor->gotoLine(info.line());
     }
   }
 }
-
@@ -17,11 +17,17 @@
 */
 #pragma once
 
+#include "symbolinfocache.h"
+#include "symboltable.h"
 #include "workerclient.h"
 #include "workerpool.h"
 
 #include <extensionsystem/iplugin.h>
 
+namespace TextEditor {
+  class TextEditorWidget;
+}
+
 namespace pyqtc {
 
 class PythonIcons;
@@ -54,8 +60,16 @@ private slots:
 private:
   static const char* kJumpToDefinition;
 
+  void JumpTo(TextEditor::TextEditorWidget* editor,
+              const pb::SymbolInfoResponse& info);
+
   WorkerPool<WorkerClient>* worker_pool_;
   PythonIcons* icons_;
+  SymbolInfoCache* symbol_info_cache_;
+  SymbolTables* symbol_tables_;
+
+  // The symbol that the last JumpToDefinition request was sent for.
+  SymbolSpan jump_span_;
 
   Projects* p;
   CompletionAssistProvider* cap;
@@ -19,20 +19,32 @@
 #include "projects.h"
 
 #include "closure.h"
+#include "constants.h"
 #include "messagehandler.h"
+#include "protostring.h"
+#include <coreplugin/documentmanager.h>
+#include <coreplugin/editormanager/editormanager.h>
+#include <coreplugin/idocument.h>
+#include <coreplugin/progressmanager/progressmanager.h>
 #include <projectexplorer/project.h>
 //#include <projectexplorer/projectexplorer.h>
 #include <projectexplorer/session.h>
 #include <utils/qtcassert.h>
 
+#include <QDir>
+#include <QFileInfo>
 #include <QtDebug>
 
 using namespace pyqtc;
 
+const int Projects::kUpdateDelayMsec = 1000;
 
-Projects::Projects(WorkerPool<WorkerClient>* worker_pool, QObject* parent)
+
+Projects::Projects(WorkerPool<WorkerClient>* worker_pool,
+                   SymbolTables* symbol_tables, QObject* parent)
   : QObject(parent),
-    worker_pool_(worker_pool)
+    worker_pool_(worker_pool),
+    symbol_tables_(symbol_tables)
 {
   QObject* session = ProjectExplorer::SessionManager::instance();
   QTC_ASSERT(session, return);
@@ -41,11 +53,25 @@ Projects::Projects(WorkerPool<WorkerClient>* worker_pool, QObject* parent)
           SLOT(ProjectAdded(ProjectExplorer::Project*)));
   connect(session, SIGNAL(aboutToRemoveProject(ProjectExplorer::Project *)),
           this, SLOT(AboutToRemoveProject(ProjectExplorer::Project*)));
+
+  connect(Core::EditorManager::instance(), SIGNAL(saved(Core::IDocument*)),
+          SLOT(DocumentSaved(Core::IDocument*)));
+  connect(Core::DocumentManager::instance(),
+          SIGNAL(filesChangedInternally(QStringList)),
+          SLOT(FilesChangedInternally(QStringList)));
+
+  update_timer_.setSingleShot(true);
+  update_timer_.setInterval(kUpdateDelayMsec);
+  connect(&update_timer_, SIGNAL(timeout()), SLOT(SendUpdates()));
 }
 
 void Projects::ProjectAdded(ProjectExplorer::Project* project) {
   const QString project_root = project->projectDirectory().toString();
 
+  python_files_[project_root] = PythonFiles(project);
+  busy_projects_.insert(project_root);
+  connect(project, SIGNAL(fileListChanged()), SLOT(FileListChanged()));
+
   WorkerClient::ReplyType* reply =
       worker_pool_->NextHandler()->CreateProject(project_root);
   NewClosure(reply, SIGNAL(Finished(bool)),
@@ -57,13 +83,240 @@ void Projects::CreateProjectFinished(WorkerClient::ReplyType* reply,
                                      const QString& project_root) {
   reply->deleteLater();
 
-  reply = worker_pool_->NextHandler()->RebuildSymbolIndex(project_root);
+  if (!busy_projects_.contains(project_root)) {
+    // The project was closed before the worker created it.
+    return;
+  }
+
+  WorkerClient* worker = worker_pool_->NextHandler();
+  StartIndexProgress(project_root, worker);
+
+  reply = worker->RebuildSymbolIndex(project_root);
+  NewClosure(reply, SIGNAL(Finished(bool)),
+             this, SLOT(RebuildSymbolIndexFinished(WorkerClient::ReplyType*,QString)),
+             reply, project_root);
+}
+
+void Projects::RebuildSymbolIndexFinished(WorkerClient::ReplyType* reply,
+                                          const QString& project_root) {
+  reply->deleteLater();
+  FinishIndexProgress(project_root);
+
+  if (!IndexFinished(project_root) || !reply->is_successful()) {
+    return;
+  }
+
+  const pb::RebuildSymbolIndexResponse& response =
+      reply->message().rebuild_symbol_index_response();
+  LoadSymbolTables(project_root, response.symbol_table_path(),
+                   response.library_table_path());
+}
+
+void Projects::StartIndexProgress(const QString& project_root,
+                                  WorkerClient* worker) {
+  connect(worker, SIGNAL(IndexProgress(QString,int,int)),
+          SLOT(IndexProgress(QString,int,int)), Qt::UniqueConnection);
+
+  Indexing* indexing = new Indexing;
+  indexing->worker_ = worker;
+  indexing->watcher_ = new QFutureWatcher<void>(this);
+  indexing->future_.reportStarted();
+  indexing->watcher_->setFuture(indexing->future_.future());
+  indexing_[project_root] = indexing;
+
+  NewClosure(indexing->watcher_, SIGNAL(canceled()),
+             this, SLOT(IndexCanceled(QString)), project_root);
+
+  Core::ProgressManager::addTask(
+      indexing->future_.future(),
+      tr("Indexing %1").arg(QFileInfo(project_root).fileName()),
+      constants::kIndexingTaskId);
+}
+
+void Projects::FinishIndexProgress(const QString& project_root) {
+  Indexing* indexing = indexing_.take(project_root);
+  if (!indexing) {
+    return;
+  }
+
+  indexing->future_.reportFinished();
+  indexing->watcher_->deleteLater();
+  delete indexing;
+}
+
+void Projects::IndexProgress(const QString& project_root, int files_done,
+                             int files_total) {
+  Indexing* indexing = indexing_.value(project_root);
+  if (!indexing) {
+    return;
+  }
+
+  indexing->future_.setProgressRange(0, files_total);
+  indexing->future_.setProgressValue(files_done);
+}
+
+void Projects::IndexCanceled(const QString& project_root) {
+  Indexing* indexing = indexing_.value(project_root);
+  if (!indexing) {
+    return;
+  }
+
+  // The worker keeps what it has indexed so far and replies as normal, so the
+  // progress is finished in RebuildSymbolIndexFinished.
+  WorkerClient::ReplyType* reply = indexing->worker_->CancelIndex(project_root);
   connect(reply, SIGNAL(Finished(bool)), reply, SLOT(deleteLater()));
 }
 
+void Projects::UpdateSymbolIndexFinished(WorkerClient::ReplyType* reply,
+                                         const QString& project_root) {
+  reply->deleteLater();
+
+  if (!IndexFinished(project_root) || !reply->is_successful()) {
+    return;
+  }
+
+  const pb::UpdateSymbolIndexResponse& response =
+      reply->message().update_symbol_index_response();
+  LoadSymbolTables(project_root, response.symbol_table_path(),
+                   response.library_table_path(),
+                   response.symbol_overlay_path());
+}
+
+bool Projects::IndexFinished(const QString& project_root) {
+  if (!busy_projects_.remove(project_root)) {
+    // The project was closed while the worker was busy.
+    return false;
+  }
+
+  // Send anything that was saved in the meantime.
+  if (pending_updates_.contains(project_root) && !update_timer_.isActive()) {
+    update_timer_.start();
+  }
+  return true;
+}
+
+void Projects::LoadSymbolTables(
+    const QString& project_root, const std::string& table_path,
+    const google::protobuf::RepeatedPtrField<std::string>& library_table_paths,
+    const std::string& overlay_path) {
+  if (!table_path.empty()) {
+    symbol_tables_->Load(project_root, ProtoStringToQString(table_path),
+                         ProtoStringToQString(overlay_path));
+  }
+
+  foreach (const std::string& path, library_table_paths) {
+    symbol_tables_->LoadLibrary(ProtoStringToQString(path));
+  }
+
+  emit SymbolIndexUpdated();
+}
+
+void Projects::DocumentSaved(Core::IDocument* document) {
+  const QString file_path = document->filePath().toString();
+  const QString project_root = ProjectRootForFile(file_path);
+
+  if (!project_root.isEmpty() && IsPythonFile(file_path)) {
+    QueueUpdate(project_root, file_path);
+  }
+}
+
+void Projects::FilesChangedInternally(const QStringList& file_paths) {
+  foreach (const QString& file_path, file_paths) {
+    const QString project_root = ProjectRootForFile(file_path);
+
+    if (!project_root.isEmpty() && IsPythonFile(file_path)) {
+      QueueUpdate(project_root, file_path);
+    }
+  }
+}
+
+void Projects::FileListChanged() {
+  ProjectExplorer::Project* project =
+      qobject_cast<ProjectExplorer::Project*>(sender());
+  QTC_ASSERT(project, return);
+
+  const QString project_root = project->projectDirectory().toString();
+  if (!python_files_.contains(project_root)) {
+    return;
+  }
+
+  const QSet<QString> old_files = python_files_[project_root];
+  const QSet<QString> new_files = PythonFiles(project);
+  python_files_[project_root] = new_files;
+
+  // The worker removes files that no longer exist from the index.
+  foreach (const QString& file_path, new_files - old_files) {
+    QueueUpdate(project_root, file_path);
+  }
+  foreach (const QString& file_path, old_files - new_files) {
+    QueueUpdate(project_root, file_path);
+  }
+}
+
+void Projects::QueueUpdate(const QString& project_root,
+                           const QString& file_path) {
+  pending_updates_[project_root].insert(file_path);
+
+  // Restart the timer so files saved in quick succession go in one batch.
+  update_timer_.start();
+}
+
+void Projects::SendUpdates() {
+  foreach (const QString& project_root, pending_updates_.keys()) {
+    if (busy_projects_.contains(project_root)) {
+      // These will be sent when the current request finishes.
+      continue;
+    }
+
+    const QStringList file_paths = pending_updates_.take(project_root).toList();
+    busy_projects_.insert(project_root);
+
+    WorkerClient::ReplyType* reply =
+        worker_pool_->NextHandler()->UpdateSymbolIndex(project_root, file_paths);
+    NewClosure(reply, SIGNAL(Finished(bool)),
+               this, SLOT(UpdateSymbolIndexFinished(WorkerClient::ReplyType*,QString)),
+               reply, project_root);
+  }
+}
+
+bool Projects::IsPythonFile(const QString& file_path) {
+  return QFileInfo(file_path).suffix() == "py";
+}
+
+QSet<QString> Projects::PythonFiles(ProjectExplorer::Project* project) {
+  QSet<QString> ret;
+  foreach (const QString& file_path,
+           project->files(ProjectExplorer::Project::SourceFiles)) {
+    if (IsPythonFile(file_path)) {
+      ret.insert(file_path);
+    }
+  }
+  return ret;
+}
+
+QString Projects::ProjectRootForFile(const QString& file_path) const {
+  const QString clean_path = QDir::cleanPath(file_path);
+
+  foreach (const QString& project_root, python_files_.keys()) {
+    if (clean_path.startsWith(project_root + "/")) {
+      return project_root;
+    }
+  }
+  return QString();
+}
+
 void Projects::AboutToRemoveProject(ProjectExplorer::Project* project) {
+  const QString project_root = project->projectDirectory().toString();
+  symbol_tables_->Remove(project_root);
+
+  disconnect(project, SIGNAL(fileListChanged()), this, SLOT(FileListChanged()));
+  python_files_.remove(project_root);
+  pending_updates_.remove(project_root);
+  busy_projects_.remove(project_root);
+  FinishIndexProgress(project_root);
+
   WorkerClient::ReplyType* reply =
-      worker_pool_->NextHandler()->DestroyProject(project->projectDirectory().toString());
+      worker_pool_->NextHandler()->DestroyProject(project_root);
 
   connect(reply, SIGNAL(Finished(bool)), reply, SLOT(deleteLater()));
 }
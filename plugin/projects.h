@@ -17,16 +17,26 @@
 */
 #pragma once
 
+#include <QFutureInterface>
+#include <QFutureWatcher>
 #include <QIcon>
+#include <QMap>
 #include <QMultiMap>
 #include <QObject>
+#include <QSet>
+#include <QTimer>
 
 #include <cplusplus/Icons.h>
 
+#include "symboltable.h"
 #include "workerclient.h"
 #include "workerpool.h"
 
 
+namespace Core {
+  class IDocument;
+}
+
 namespace ProjectExplorer {
   class Project;
 }
@@ -35,11 +45,23 @@ namespace pyqtc {
 
 class WorkerClient;
 
+// Tells the worker about projects as they are opened and closed, and keeps
+// their symbol indexes up to date.  Saved files and files added to or removed
+// from a project are collected for a short while and then sent to the worker
+// in one batch per project.  Rebuilds are shown in the progress manager, and
+// cancelling one there stops the worker after its current batch of files.
 class Projects : public QObject {
   Q_OBJECT
 
 public:
-  Projects(WorkerPool<WorkerClient>* worker_pool, QObject* parent = 0);
+  Projects(WorkerPool<WorkerClient>* worker_pool, SymbolTables* symbol_tables,
+           QObject* parent = 0);
+
+  static const int kUpdateDelayMsec;
+
+signals:
+  // Emitted when a project's symbol index was rebuilt or updated.
+  void SymbolIndexUpdated();
 
 private slots:
   void ProjectAdded(ProjectExplorer::Project* project);
@@ -47,9 +69,65 @@ private slots:
 
   void CreateProjectFinished(WorkerClient::ReplyType* reply,
                              const QString& project_root);
+  void RebuildSymbolIndexFinished(WorkerClient::ReplyType* reply,
+                                  const QString& project_root);
+  void IndexProgress(const QString& project_root, int files_done,
+                     int files_total);
+  void IndexCanceled(const QString& project_root);
+
+  void DocumentSaved(Core::IDocument* document);
+  void FilesChangedInternally(const QStringList& file_paths);
+  void FileListChanged();
+
+  void SendUpdates();
+  void UpdateSymbolIndexFinished(WorkerClient::ReplyType* reply,
+                                 const QString& project_root);
+
+private:
+  static bool IsPythonFile(const QString& file_path);
+  static QSet<QString> PythonFiles(ProjectExplorer::Project* project);
+
+  // Returns the root of the open project that contains file_path, or an empty
+  // string if it's not in any project.
+  QString ProjectRootForFile(const QString& file_path) const;
+
+  void QueueUpdate(const QString& project_root, const QString& file_path);
+  // Called when a rebuild or update finishes.  Returns false if the project
+  // was closed in the meantime.
+  bool IndexFinished(const QString& project_root);
+  void StartIndexProgress(const QString& project_root, WorkerClient* worker);
+  void FinishIndexProgress(const QString& project_root);
+  void LoadSymbolTables(
+      const QString& project_root, const std::string& table_path,
+      const google::protobuf::RepeatedPtrField<std::string>& library_table_paths,
+      const std::string& overlay_path = std::string());
 
 private:
+  // A rebuild that is shown in the progress manager.
+  struct Indexing {
+    WorkerClient* worker_;
+    QFutureInterface<void> future_;
+    QFutureWatcher<void>* watcher_;
+  };
+
   WorkerPool<WorkerClient>* worker_pool_;
+  SymbolTables* symbol_tables_;
+
+  // The python files in each project, by project root, so we can tell which
+  // files were added or removed when the project's file list changes.
+  QMap<QString, QSet<QString> > python_files_;
+
+  // Files waiting to be sent to the worker, by project root.
+  QMap<QString, QSet<QString> > pending_updates_;
+
+  // Projects that have a rebuild or update in progress.  Only one request is
+  // sent for each project at a time.
+  QSet<QString> busy_projects_;
+
+  // Rebuilds in progress, by project root.
+  QMap<QString, Indexing*> indexing_;
+
+  QTimer update_timer_;
 };
 
 } // namespace pyqtc
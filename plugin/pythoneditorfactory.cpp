@@ -34,7 +34,8 @@
 //using namespace pyqtc;
 using pyqtc::PythonEditorFactory;
 
-PythonEditorFactory::PythonEditorFactory(QObject* parent, WorkerPool<WorkerClient> *worker_pool)
+PythonEditorFactory::PythonEditorFactory(QObject* parent, WorkerPool<WorkerClient> *worker_pool,
+                                         pyqtc::SymbolInfoCache* symbol_info_cache)
   : TextEditor::TextEditorFactory(parent)
 {
     setId(pyqtc::constants::kEditorId);
@@ -62,7 +63,7 @@ PythonEditorFactory::PythonEditorFactory(QObject* parent, WorkerPool<WorkerClien
         | TextEditor::TextEditorActionHandler::UnCommentSelection
         | TextEditor::TextEditorActionHandler::UnCollapseAll);
 
-    addHoverHandler(new pyqtc::HoverHandler(worker_pool));
+    addHoverHandler(new pyqtc::HoverHandler(worker_pool, symbol_info_cache));
 }
 
 PythonEditorFactory::~PythonEditorFactory() {
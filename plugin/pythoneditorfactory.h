@@ -17,6 +17,7 @@
 */
 #pragma once
 
+#include "workerclient.h"
 #include "workerpool.h"
 #include <coreplugin/editormanager/ieditorfactory.h>
 #include <texteditor/texteditor.h>
@@ -24,9 +25,12 @@
 
 namespace pyqtc {
 
+class SymbolInfoCache;
+
 class PythonEditorFactory : public TextEditor::TextEditorFactory {
 public:
-    PythonEditorFactory(QObject* parent, WorkerPool<WorkerClient>* worker_pool);
+    PythonEditorFactory(QObject* parent, WorkerPool<WorkerClient>* worker_pool,
+                        SymbolInfoCache* symbol_info_cache);
     ~PythonEditorFactory();
 };
 
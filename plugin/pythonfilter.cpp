@@ -29,10 +29,14 @@
 
 using namespace pyqtc;
 
+const int PythonFilterBase::kMaxResults = 1000;
+
 PythonFilterBase::PythonFilterBase(WorkerPool<WorkerClient>* worker_pool,
+                                   SymbolTables* symbol_tables,
                                    const PythonIcons* icons)
   : Core::ILocatorFilter(NULL),
     worker_pool_(worker_pool),
+    symbol_tables_(symbol_tables),
     icons_(icons),
     symbol_type_(pb::ALL),
     file_path_(QString())
@@ -41,6 +45,38 @@ PythonFilterBase::PythonFilterBase(WorkerPool<WorkerClient>* worker_pool,
 
 QList<Core::LocatorFilterEntry> PythonFilterBase::matchesFor(
     QFutureInterface<Core::LocatorFilterEntry>& future, const QString& entry) {
+  // Until the worker has exported a symbol table there's nothing to search
+  // locally.
+  if (symbol_tables_->IsEmpty()) {
+    return SearchWorker(future, entry);
+  }
+
+  QList<Core::LocatorFilterEntry> ret;
+
+  const QList<SymbolTable::Result> results =
+      symbol_tables_->Search(entry, file_path_, symbol_type_, kMaxResults);
+
+  foreach (const SymbolTable::Result& result, results) {
+    if (future.isCanceled()) {
+      break;
+    }
+
+    EntryInternalData internal_data(result.file_path_, result.line_number_);
+
+    Core::LocatorFilterEntry entry(this, result.symbol_name_,
+                                   QVariant::fromValue(internal_data));
+    entry.extraInfo = result.module_name_;
+    entry.displayIcon = icons_->IconForSearchResult(
+          result.symbol_type_, result.symbol_name_.startsWith('_'));
+
+    ret << entry;
+  }
+
+  return ret;
+}
+
+QList<Core::LocatorFilterEntry> PythonFilterBase::SearchWorker(
+    QFutureInterface<Core::LocatorFilterEntry>& future, const QString& entry) {
   QScopedPointer<WorkerClient::ReplyType> reply(
         worker_pool_->NextHandler()->Search(entry, file_path_, symbol_type_));
   reply->WaitForFinished();
@@ -84,12 +120,15 @@ void PythonFilterBase::accept(Core::LocatorFilterEntry selection) const {
 }
 
 void PythonFilterBase::refresh(QFutureInterface<void>& future) {
+  Q_UNUSED(future)
+  symbol_tables_->Reload();
 }
 
 
 PythonClassFilter::PythonClassFilter(
-    WorkerPool<WorkerClient>* worker_pool, const PythonIcons* icons)
-  : PythonFilterBase(worker_pool, icons)
+    WorkerPool<WorkerClient>* worker_pool, SymbolTables* symbol_tables,
+    const PythonIcons* icons)
+  : PythonFilterBase(worker_pool, symbol_tables, icons)
 {
   set_symbol_type(pb::CLASS);
   setShortcutString("c");
@@ -97,8 +136,9 @@ PythonClassFilter::PythonClassFilter(
 
 
 PythonFunctionFilter::PythonFunctionFilter(
-    WorkerPool<WorkerClient>* worker_pool, const PythonIcons* icons)
-  : PythonFilterBase(worker_pool, icons)
+    WorkerPool<WorkerClient>* worker_pool, SymbolTables* symbol_tables,
+    const PythonIcons* icons)
+  : PythonFilterBase(worker_pool, symbol_tables, icons)
 {
   set_symbol_type(pb::FUNCTION);
   setShortcutString("m");
@@ -106,8 +146,9 @@ PythonFunctionFilter::PythonFunctionFilter(
 
 
 PythonCurrentDocumentFilter::PythonCurrentDocumentFilter(
-    WorkerPool<WorkerClient>* worker_pool, const PythonIcons* icons)
-  : PythonFilterBase(worker_pool, icons)
+    WorkerPool<WorkerClient>* worker_pool, SymbolTables* symbol_tables,
+    const PythonIcons* icons)
+  : PythonFilterBase(worker_pool, symbol_tables, icons)
 {
   Core::EditorManager* editor_manager = Core::EditorManager::instance();
 
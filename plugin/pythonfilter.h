@@ -18,6 +18,7 @@
 #pragma once
 #include <coreplugin/locator/ilocatorfilter.h>
 
+#include "symboltable.h"
 #include "workerclient.h"
 #include "workerpool.h"
 
@@ -33,6 +34,7 @@ class PythonIcons;
 class PythonFilterBase : public Core::ILocatorFilter {
 public:
   PythonFilterBase(WorkerPool<WorkerClient>* worker_pool,
+                   SymbolTables* symbol_tables,
                    const PythonIcons* icons);
 
   Priority priority() const { return Medium; }
@@ -56,7 +58,13 @@ protected:
   void set_file_path(const QString& file_path) { file_path_ = file_path; }
 
 private:
+  static const int kMaxResults;
+
+  QList<Core::LocatorFilterEntry> SearchWorker(
+      QFutureInterface<Core::LocatorFilterEntry>& future, const QString& entry);
+
   WorkerPool<WorkerClient>* worker_pool_;
+  SymbolTables* symbol_tables_;
   const PythonIcons* icons_;
 
   pb::SymbolType symbol_type_;
@@ -67,6 +75,7 @@ private:
 class PythonClassFilter : public PythonFilterBase {
 public:
   PythonClassFilter(WorkerPool<WorkerClient>* worker_pool,
+                    SymbolTables* symbol_tables,
                     const PythonIcons* icons);
 
   QString displayName() const { return tr("Classes (Python)"); }
@@ -84,6 +93,7 @@ public:
 class PythonFunctionFilter : public PythonFilterBase {
 public:
   PythonFunctionFilter(WorkerPool<WorkerClient>* worker_pool,
+                       SymbolTables* symbol_tables,
                        const PythonIcons* icons);
 
   QString displayName() const { return tr("Methods and functions (Python)"); }
@@ -102,6 +112,7 @@ class PythonCurrentDocumentFilter : public PythonFilterBase {
 
 public:
   PythonCurrentDocumentFilter(WorkerPool<WorkerClient>* worker_pool,
+                              SymbolTables* symbol_tables,
                               const PythonIcons* icons);
 
   QString displayName() const { return tr("Methods in Current Document (Python)"); }
@@ -24,53 +24,78 @@
 
 using namespace pyqtc;
 
-QIcon PythonIcons::IconForCompletionProposal(
-      const pb::CompletionResponse_Proposal& proposal) const {
-  Utils::CodeModelIcon::Type type = Utils::CodeModelIcon::Unknown;
-
-  const bool is_private = ProtoStringToQString(proposal.name()).startsWith("_");
+namespace {
 
+Utils::CodeModelIcon::Type CodeModelTypeForProposal(
+    pb::CompletionResponse_Proposal_Type type,
+    pb::CompletionResponse_Proposal_Scope scope,
+    bool is_private) {
   // Keywords are treated differently
-  switch (proposal.scope()) {
-  case pb::CompletionResponse_Proposal_Scope_KEYWORD:
-    type = Utils::CodeModelIcon::Keyword;
-    break;
+  if (scope == pb::CompletionResponse_Proposal_Scope_KEYWORD) {
+    return Utils::CodeModelIcon::Keyword;
+  }
+
+  // Continue to look at the type
+  switch (type) {
+  case pb::CompletionResponse_Proposal_Type_INSTANCE:
+    return is_private ?
+          Utils::CodeModelIcon::VarPrivate:
+          Utils::CodeModelIcon::VarPublic;
+
+  case pb::CompletionResponse_Proposal_Type_CLASS:
+    return Utils::CodeModelIcon::Class;
+
+  case pb::CompletionResponse_Proposal_Type_FUNCTION:
+    return is_private ?
+          Utils::CodeModelIcon::FuncPrivate:
+          Utils::CodeModelIcon::FuncPublic;
+
+  case pb::CompletionResponse_Proposal_Type_MODULE:
+    return Utils::CodeModelIcon::Namespace;
+  }
+
+  return Utils::CodeModelIcon::Unknown;
+}
 
-  default:
-    // Continue to look at the type
-    switch (proposal.type()) {
-    case pb::CompletionResponse_Proposal_Type_INSTANCE:
-      type = is_private ?
-            Utils::CodeModelIcon::VarPrivate:
-            Utils::CodeModelIcon::VarPublic;
-      break;
-
-    case pb::CompletionResponse_Proposal_Type_CLASS:
-      type = Utils::CodeModelIcon::Class;
-      break;
-
-    case pb::CompletionResponse_Proposal_Type_FUNCTION:
-      type = is_private ?
-            Utils::CodeModelIcon::FuncPrivate:
-            Utils::CodeModelIcon::FuncPublic;
-      break;
-
-    case pb::CompletionResponse_Proposal_Type_MODULE:
-      type = Utils::CodeModelIcon::Namespace;
-      break;
+} // namespace
+
+PythonIcons::PythonIcons() {
+  for (int type=0 ; type<kTypeCount ; ++type) {
+    for (int scope=0 ; scope<kScopeCount ; ++scope) {
+      for (int is_private=0 ; is_private<2 ; ++is_private) {
+        completion_icons_[type][scope][is_private] =
+            Utils::CodeModelIcon::iconForType(CodeModelTypeForProposal(
+                pb::CompletionResponse_Proposal_Type(type),
+                pb::CompletionResponse_Proposal_Scope(scope),
+                is_private));
+      }
     }
-    break;
   }
+}
 
-  return Utils::CodeModelIcon::iconForType(type);
+QIcon PythonIcons::IconForCompletionProposal(
+      const pb::CompletionResponse_Proposal& proposal) const {
+  return IconForCompletionProposal(proposal.type(), proposal.scope(),
+                                   IsPrivateName(proposal.name()));
+}
+
+QIcon PythonIcons::IconForCompletionProposal(
+      pb::CompletionResponse_Proposal_Type type,
+      pb::CompletionResponse_Proposal_Scope scope,
+      bool is_private) const {
+  return completion_icons_[type][scope][is_private ? 1 : 0];
 }
 
 QIcon PythonIcons::IconForSearchResult(const pb::SearchResponse_Result& result) const {
-  Utils::CodeModelIcon::Type type = Utils::CodeModelIcon::Unknown;
+  return IconForSearchResult(result.symbol_type(),
+                             IsPrivateName(result.symbol_name()));
+}
 
-  const bool is_private = ProtoStringToQString(result.symbol_name()).startsWith("_");
+QIcon PythonIcons::IconForSearchResult(pb::SymbolType symbol_type,
+                                       bool is_private) const {
+  Utils::CodeModelIcon::Type type = Utils::CodeModelIcon::Unknown;
 
-  switch (result.symbol_type()) {
+  switch (symbol_type) {
   case pb::VARIABLE:
     type = is_private ?
           Utils::CodeModelIcon::VarPrivate:
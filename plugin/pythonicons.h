@@ -22,12 +22,32 @@
 #include <QIcon>
 #include <QScopedPointer>
 
+#include <string>
+
 namespace pyqtc {
 
 class PythonIcons {
 public:
+  PythonIcons();
+
   QIcon IconForCompletionProposal(const pb::CompletionResponse_Proposal& proposal) const;
+  QIcon IconForCompletionProposal(pb::CompletionResponse_Proposal_Type type,
+                                  pb::CompletionResponse_Proposal_Scope scope,
+                                  bool is_private) const;
   QIcon IconForSearchResult(const pb::SearchResponse_Result& result) const;
+  QIcon IconForSearchResult(pb::SymbolType type, bool is_private) const;
+
+  static bool IsPrivateName(const std::string& name) {
+    return !name.empty() && name[0] == '_';
+  }
+
+private:
+  static const int kTypeCount = pb::CompletionResponse_Proposal_Type_Type_MAX + 1;
+  static const int kScopeCount = pb::CompletionResponse_Proposal_Scope_Scope_MAX + 1;
+
+  // Completion icons are looked up for every visible proposal, so they're
+  // all created up front and indexed by [type][scope][is_private].
+  QIcon completion_icons_[kTypeCount][kScopeCount][2];
 };
 
 } // namespace pyqtc
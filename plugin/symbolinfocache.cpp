@@ -0,0 +1,123 @@
+/*  pyqtc - QtCreator plugin with code completion using rope.
+    Copyright 2011 David Sansome <me@davidsansome.com>
+    Copyright 2017 Alexander Izmailov <yarolig@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "symbolinfocache.h"
+
+#include <texteditor/texteditor.h>
+
+using namespace pyqtc;
+
+SymbolSpan SymbolSpan::At(TextEditor::TextEditorWidget* editor, int pos) {
+  SymbolSpan span;
+  QTextDocument* document = editor->document();
+
+  int start = pos;
+  while (start > 0) {
+    const QChar c = document->characterAt(start - 1);
+    if (!c.isLetterOrNumber() && c != '_')
+      break;
+    --start;
+  }
+
+  int end = pos;
+  forever {
+    const QChar c = document->characterAt(end);
+    if (!c.isLetterOrNumber() && c != '_')
+      break;
+    ++end;
+  }
+
+  if (start == end)
+    return span;
+
+  span.editor_ = editor;
+  span.document_ = document;
+  span.revision_ = document->revision();
+  span.start_ = start;
+  span.end_ = end;
+  span.position_ = pos;
+  return span;
+}
+
+
+SymbolInfoCache::SymbolInfoCache(QObject* parent)
+  : QObject(parent)
+{
+}
+
+bool SymbolInfoCache::Find(const SymbolSpan& span,
+                           pb::SymbolInfoResponse* info) const {
+  QHash<QTextDocument*, DocumentCache>::const_iterator it =
+      cache_.constFind(span.document_.data());
+  if (it == cache_.constEnd() || it->revision_ != span.revision_)
+    return false;
+
+  QHash<QPair<int, int>, pb::SymbolInfoResponse>::const_iterator entry =
+      it->infos_.constFind(qMakePair(span.start_, span.end_));
+  if (entry == it->infos_.constEnd())
+    return false;
+
+  info->CopyFrom(*entry);
+  return true;
+}
+
+void SymbolInfoCache::Insert(const SymbolSpan& span,
+                             const pb::SymbolInfoResponse& info) {
+  if (!span.IsCurrent())
+    return;
+
+  QTextDocument* document = span.document_.data();
+
+  if (!cache_.contains(document)) {
+    connect(document, SIGNAL(contentsChange(int,int,int)),
+            SLOT(DocumentContentsChanged(int,int,int)));
+    connect(document, SIGNAL(destroyed(QObject*)),
+            SLOT(DocumentDestroyed(QObject*)));
+  }
+
+  DocumentCache& cache = cache_[document];
+  if (cache.revision_ != span.revision_) {
+    cache.revision_ = span.revision_;
+    cache.infos_.clear();
+  }
+  cache.infos_[qMakePair(span.start_, span.end_)] = info;
+}
+
+void SymbolInfoCache::Clear() {
+  foreach (QTextDocument* document, cache_.keys()) {
+    disconnect(document, 0, this, 0);
+  }
+  cache_.clear();
+}
+
+void SymbolInfoCache::DocumentContentsChanged(int position, int chars_removed,
+                                              int chars_added) {
+  Q_UNUSED(position)
+
+  // Formatting changes from the highlighter don't invalidate anything.
+  if (chars_removed == 0 && chars_added == 0)
+    return;
+
+  QTextDocument* document = static_cast<QTextDocument*>(sender());
+  cache_.remove(document);
+  disconnect(document, 0, this, 0);
+}
+
+void SymbolInfoCache::DocumentDestroyed(QObject* document) {
+  cache_.remove(static_cast<QTextDocument*>(document));
+}
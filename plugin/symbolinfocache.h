@@ -0,0 +1,91 @@
+/*  pyqtc - QtCreator plugin with code completion using rope.
+    Copyright 2011 David Sansome <me@davidsansome.com>
+    Copyright 2017 Alexander Izmailov <yarolig@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "rpc.pb.h"
+
+#include <QHash>
+#include <QObject>
+#include <QPair>
+#include <QPointer>
+#include <QTextDocument>
+
+namespace TextEditor {
+  class TextEditorWidget;
+}
+
+namespace pyqtc {
+
+// The identifier at a position in a particular revision of a document.
+struct SymbolSpan {
+  SymbolSpan() : revision_(-1), start_(-1), end_(-1), position_(-1) {}
+
+  // Returns an invalid span if there is no identifier at pos.
+  static SymbolSpan At(TextEditor::TextEditorWidget* editor, int pos);
+
+  bool IsValid() const { return document_ && start_ != -1; }
+  bool IsCurrent() const {
+    return IsValid() && document_->revision() == revision_;
+  }
+
+  bool operator ==(const SymbolSpan& other) const {
+    return document_ == other.document_ && revision_ == other.revision_ &&
+           start_ == other.start_ && end_ == other.end_;
+  }
+
+  QPointer<TextEditor::TextEditorWidget> editor_;
+  QPointer<QTextDocument> document_;
+  int revision_;
+  int start_;
+  int end_;
+  int position_;
+};
+
+
+// Remembers SymbolInfo replies so hovering over a symbol and then following
+// it with F2 only costs one analysis in the worker.  A document's entries are
+// dropped as soon as its text changes, and all of them when the symbol index
+// is updated, since another file's change can move a definition.
+class SymbolInfoCache : public QObject {
+  Q_OBJECT
+
+public:
+  SymbolInfoCache(QObject* parent = 0);
+
+  bool Find(const SymbolSpan& span, pb::SymbolInfoResponse* info) const;
+  void Insert(const SymbolSpan& span, const pb::SymbolInfoResponse& info);
+
+public slots:
+  void Clear();
+
+private slots:
+  void DocumentContentsChanged(int position, int chars_removed, int chars_added);
+  void DocumentDestroyed(QObject* document);
+
+private:
+  struct DocumentCache {
+    DocumentCache() : revision_(-1) {}
+
+    int revision_;
+    QHash<QPair<int, int>, pb::SymbolInfoResponse> infos_;
+  };
+
+  QHash<QTextDocument*, DocumentCache> cache_;
+};
+
+} // namespace pyqtc
@@ -0,0 +1,528 @@
+/*  pyqtc - QtCreator plugin with code completion using rope.
+    Copyright 2011 David Sansome <me@davidsansome.com>
+    Copyright 2017 Alexander Izmailov <yarolig@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "symboltable.h"
+
+#include <QSet>
+#include <QtEndian>
+
+#include <algorithm>
+
+using namespace pyqtc;
+
+namespace {
+
+// Must match SymbolIndex.TABLE_* in the worker.
+const char kMagic[] = "PYQTCSYM";
+const quint32 kVersion = 1;
+const int kHeaderSize = 8 + 10 * 4;
+const int kFileRecordSize = 4 * 4;
+const int kSymbolRecordSize = 5 * 4;
+const int kTrigramRecordSize = 3 * 4;
+const int kPostingSize = 4;
+
+inline char AsciiLower(char c) {
+  return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+// Returns the offset of needle in haystack ignoring ASCII case, or -1.
+// needle must already be lowercase.
+int FindIgnoringCase(const char* haystack, int haystack_length,
+                     const QByteArray& needle) {
+  const int needle_length = needle.length();
+  for (int i=0 ; i + needle_length <= haystack_length ; ++i) {
+    int j = 0;
+    while (j < needle_length && AsciiLower(haystack[i + j]) == needle[j]) {
+      ++j;
+    }
+    if (j == needle_length) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+quint32 Generation(const QSharedPointer<const SymbolTable>& table) {
+  return table ? table->generation() : 0;
+}
+
+} // namespace
+
+
+SymbolTable::SymbolTable(const QString& filename)
+  : file_(filename),
+    data_(NULL),
+    size_(0),
+    generation_(0),
+    file_count_(0),
+    symbol_count_(0),
+    trigram_count_(0),
+    files_offset_(0),
+    symbols_offset_(0),
+    trigrams_offset_(0),
+    postings_offset_(0),
+    strings_offset_(0)
+{
+}
+
+QSharedPointer<const SymbolTable> SymbolTable::Open(const QString& filename) {
+  QSharedPointer<SymbolTable> table(new SymbolTable(filename));
+  if (!table->Map()) {
+    return QSharedPointer<const SymbolTable>();
+  }
+  return table;
+}
+
+bool SymbolTable::Map() {
+  if (!file_.open(QIODevice::ReadOnly)) {
+    return false;
+  }
+
+  size_ = file_.size();
+  if (size_ < kHeaderSize || size_ > 0xFFFFFFFFll) {
+    return false;
+  }
+
+  data_ = file_.map(0, size_);
+  if (!data_ || memcmp(data_, kMagic, 8) != 0 ||
+      ReadUInt32(8) != kVersion) {
+    return false;
+  }
+
+  generation_      = ReadUInt32(12);
+  file_count_      = ReadUInt32(16);
+  symbol_count_    = ReadUInt32(20);
+  trigram_count_   = ReadUInt32(24);
+  files_offset_    = ReadUInt32(28);
+  symbols_offset_  = ReadUInt32(32);
+  trigrams_offset_ = ReadUInt32(36);
+  postings_offset_ = ReadUInt32(40);
+  strings_offset_  = ReadUInt32(44);
+
+  // Make sure all the sections fit in the file, so the rest of the class
+  // only has to check string records.
+  return
+      files_offset_ + quint64(file_count_) * kFileRecordSize <= symbols_offset_ &&
+      symbols_offset_ + quint64(symbol_count_) * kSymbolRecordSize <= trigrams_offset_ &&
+      trigrams_offset_ + quint64(trigram_count_) * kTrigramRecordSize <= postings_offset_ &&
+      postings_offset_ <= strings_offset_ &&
+      strings_offset_ <= size_;
+}
+
+quint32 SymbolTable::ReadUInt32(quint32 offset) const {
+  return qFromLittleEndian<quint32>(data_ + offset);
+}
+
+QByteArray SymbolTable::String(quint32 record_offset) const {
+  const quint64 offset = quint64(strings_offset_) + ReadUInt32(record_offset);
+  const quint32 length = ReadUInt32(record_offset + 4);
+  if (offset + length > quint64(size_)) {
+    return QByteArray();
+  }
+
+  // Points into the mapped file, no copy.
+  return QByteArray::fromRawData(
+        reinterpret_cast<const char*>(data_ + offset), length);
+}
+
+QString SymbolTable::DecodedString(quint32 record_offset) const {
+  const QByteArray data = String(record_offset);
+  return QString::fromUtf8(data.constData(), data.size());
+}
+
+quint32 SymbolTable::SymbolRecord(quint32 index) const {
+  return symbols_offset_ + index * kSymbolRecordSize;
+}
+
+quint32 SymbolTable::FileRecord(quint32 index) const {
+  return files_offset_ + index * kFileRecordSize;
+}
+
+bool SymbolTable::FindPostings(quint32 trigram, quint32* first,
+                               quint32* count) const {
+  // The trigram records are sorted, so binary search them.
+  quint32 low = 0;
+  quint32 high = trigram_count_;
+  while (low < high) {
+    const quint32 mid = low + (high - low) / 2;
+    const quint32 record = trigrams_offset_ + mid * kTrigramRecordSize;
+    const quint32 key = ReadUInt32(record);
+
+    if (key < trigram) {
+      low = mid + 1;
+    } else if (key > trigram) {
+      high = mid;
+    } else {
+      *first = ReadUInt32(record + 4);
+      *count = ReadUInt32(record + 8);
+      return postings_offset_ + quint64(*first + *count) * kPostingSize <=
+             strings_offset_;
+    }
+  }
+  return false;
+}
+
+bool SymbolTable::Match::operator <(const Match& other) const {
+  if (prefix_match_ != other.prefix_match_) {
+    return prefix_match_;
+  }
+  if (name_length_ != other.name_length_) {
+    return name_length_ < other.name_length_;
+  }
+  return index_ < other.index_;
+}
+
+void SymbolTable::FindPrefixRange(const QByteArray& needle, quint32* begin,
+                                  quint32* end) const {
+  // Symbols are sorted by their ASCII-lowercased names, so the names that
+  // start with needle are all next to each other.  Compare only the first
+  // needle.length() characters: 0 means the name starts with needle.
+  const int needle_length = needle.length();
+  const auto compare = [&](quint32 index) {
+    const QByteArray name = String(SymbolRecord(index));
+    for (int i=0 ; i<needle_length ; ++i) {
+      if (i >= name.size()) {
+        return -1;
+      }
+      const uchar c = uchar(AsciiLower(name[i]));
+      if (c != uchar(needle[i])) {
+        return c < uchar(needle[i]) ? -1 : 1;
+      }
+    }
+    return 0;
+  };
+
+  quint32 low = 0;
+  quint32 high = symbol_count_;
+  while (low < high) {
+    const quint32 mid = low + (high - low) / 2;
+    if (compare(mid) < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  *begin = low;
+
+  high = symbol_count_;
+  while (low < high) {
+    const quint32 mid = low + (high - low) / 2;
+    if (compare(mid) <= 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  *end = low;
+}
+
+bool SymbolTable::IsWanted(quint32 index, qint64 file_id,
+                           pb::SymbolType type,
+                           const QBitArray& hidden_files) const {
+  if (index >= symbol_count_) {
+    return false;
+  }
+
+  const quint32 record = SymbolRecord(index);
+  const quint32 symbol_file_id = ReadUInt32(record + 8);
+  if (file_id != -1 && symbol_file_id != file_id) {
+    return false;
+  }
+  if (symbol_file_id < quint32(hidden_files.size()) &&
+      hidden_files.testBit(symbol_file_id)) {
+    return false;
+  }
+  if (type != pb::ALL && ReadUInt32(record + 16) != quint32(type)) {
+    return false;
+  }
+  return true;
+}
+
+void SymbolTable::AddMatch(quint32 index, const QByteArray& needle,
+                           QVector<Match>* matches) const {
+  const QByteArray name = String(SymbolRecord(index));
+  const int match = FindIgnoringCase(name.constData(), name.size(), needle);
+  if (match == -1) {
+    return;
+  }
+
+  // Matches at the start of the name or of any dotted part rank higher.
+  Match m;
+  m.prefix_match_ = match == 0 || name[match - 1] == '.';
+  m.name_length_ = name.size();
+  m.index_ = index;
+  matches->append(m);
+}
+
+QList<SymbolTable::Result> SymbolTable::Search(
+    const QString& query, const QString& file_path,
+    pb::SymbolType type, int limit, const QBitArray& hidden_files) const {
+  QList<Result> ret;
+  if (limit <= 0) {
+    return ret;
+  }
+
+  QByteArray needle = query.trimmed().toUtf8();
+  for (int i=0 ; i<needle.length() ; ++i) {
+    needle[i] = AsciiLower(needle[i]);
+  }
+
+  // Restrict the search to one file.
+  qint64 file_id = -1;
+  if (!file_path.isEmpty()) {
+    const QByteArray file_path_utf8 = file_path.toUtf8();
+    for (quint32 i=0 ; i<file_count_ ; ++i) {
+      if (String(FileRecord(i)) == file_path_utf8) {
+        file_id = i;
+        break;
+      }
+    }
+    if (file_id == -1) {
+      return ret;
+    }
+  }
+
+  QVector<Match> matches;
+
+  if (needle.length() < 3) {
+    // Too short for a trigram.  The names that start with the query are found
+    // with a binary search, and the rest are only scanned for matches in the
+    // middle if there weren't enough of those.
+    quint32 begin = 0;
+    quint32 end = 0;
+    FindPrefixRange(needle, &begin, &end);
+
+    for (quint32 i=begin ; i<end ; ++i) {
+      if (IsWanted(i, file_id, type, hidden_files)) {
+        Match m;
+        m.prefix_match_ = true;
+        m.name_length_ = ReadUInt32(SymbolRecord(i) + 4);
+        m.index_ = i;
+        matches.append(m);
+      }
+    }
+
+    if (matches.count() < limit) {
+      for (quint32 i=0 ; i<symbol_count_ ; ++i) {
+        if (i == begin) {
+          i = end;
+          if (i >= symbol_count_) {
+            break;
+          }
+        }
+        if (IsWanted(i, file_id, type, hidden_files)) {
+          AddMatch(i, needle, &matches);
+        }
+      }
+    }
+  } else {
+    // Every trigram of the query has to be in the name, so only the symbols
+    // in the shortest posting list need to be looked at.
+    quint32 first_posting = 0;
+    quint32 candidate_count = 0;
+    bool found = false;
+
+    for (int i=0 ; i + 2 < needle.length() ; ++i) {
+      const quint32 trigram = quint32(uchar(needle[i])) << 16 |
+                              quint32(uchar(needle[i+1])) << 8 |
+                              quint32(uchar(needle[i+2]));
+      quint32 first = 0;
+      quint32 count = 0;
+      if (!FindPostings(trigram, &first, &count)) {
+        return ret;
+      }
+      if (!found || count < candidate_count) {
+        first_posting = first;
+        candidate_count = count;
+        found = true;
+      }
+    }
+
+    for (quint32 i=0 ; i<candidate_count ; ++i) {
+      const quint32 index =
+          ReadUInt32(postings_offset_ + (first_posting + i) * kPostingSize);
+      if (IsWanted(index, file_id, type, hidden_files)) {
+        AddMatch(index, needle, &matches);
+      }
+    }
+  }
+
+  // Only the best limit matches are decoded.
+  const int count = qMin(limit, matches.count());
+  std::partial_sort(matches.begin(), matches.begin() + count, matches.end());
+
+  ret.reserve(count);
+  for (int i=0 ; i<count ; ++i) {
+    ret.append(MakeResult(matches[i]));
+  }
+  return ret;
+}
+
+QBitArray SymbolTable::FilesIn(const SymbolTable& other) const {
+  QSet<QByteArray> other_files;
+  for (quint32 i=0 ; i<other.file_count_ ; ++i) {
+    other_files.insert(other.String(other.FileRecord(i)));
+  }
+
+  QBitArray ret(file_count_);
+  for (quint32 i=0 ; i<file_count_ ; ++i) {
+    if (other_files.contains(String(FileRecord(i)))) {
+      ret.setBit(i);
+    }
+  }
+  return ret;
+}
+
+SymbolTable::Result SymbolTable::MakeResult(const Match& match) const {
+  const quint32 record = SymbolRecord(match.index_);
+  const quint32 file_id = ReadUInt32(record + 8);
+
+  Result result;
+  result.symbol_name_ = DecodedString(record);
+  result.line_number_ = ReadUInt32(record + 12);
+  result.symbol_type_ = pb::SymbolType(ReadUInt32(record + 16));
+  result.prefix_match_ = match.prefix_match_;
+
+  if (file_id < file_count_) {
+    result.file_path_ = DecodedString(FileRecord(file_id));
+    result.module_name_ = DecodedString(FileRecord(file_id) + 8);
+  }
+
+  return result;
+}
+
+
+SymbolTables::ProjectTables SymbolTables::Open(const Filenames& filenames) {
+  ProjectTables ret;
+  ret.table_ = SymbolTable::Open(filenames.table_);
+  if (!filenames.overlay_.isEmpty()) {
+    ret.overlay_ = SymbolTable::Open(filenames.overlay_);
+  }
+  if (ret.table_ && ret.overlay_) {
+    ret.hidden_files_ = ret.table_->FilesIn(*ret.overlay_);
+  }
+  return ret;
+}
+
+void SymbolTables::Load(const QString& project_root, const QString& filename,
+                        const QString& overlay_filename) {
+  Filenames filenames;
+  filenames.table_ = filename;
+  filenames.overlay_ = overlay_filename;
+
+  // Map the files before taking the lock so searches aren't held up.
+  const ProjectTables tables = Open(filenames);
+
+  QMutexLocker l(&mutex_);
+  filenames_[project_root] = filenames;
+  if (tables.table_) {
+    tables_[project_root] = tables;
+  }
+}
+
+void SymbolTables::Remove(const QString& project_root) {
+  QMutexLocker l(&mutex_);
+  filenames_.remove(project_root);
+  tables_.remove(project_root);
+}
+
+void SymbolTables::LoadLibrary(const QString& filename) {
+  {
+    QMutexLocker l(&mutex_);
+    if (library_tables_.contains(filename)) {
+      return;
+    }
+  }
+
+  QSharedPointer<const SymbolTable> table = SymbolTable::Open(filename);
+  if (!table) {
+    return;
+  }
+
+  QMutexLocker l(&mutex_);
+  library_tables_[filename] = table;
+}
+
+void SymbolTables::Reload() {
+  QMap<QString, Filenames> filenames;
+  {
+    QMutexLocker l(&mutex_);
+    filenames = filenames_;
+  }
+
+  for (QMap<QString, Filenames>::const_iterator it = filenames.constBegin() ;
+       it != filenames.constEnd() ; ++it) {
+    const ProjectTables tables = Open(it.value());
+    if (!tables.table_) {
+      continue;
+    }
+
+    QMutexLocker l(&mutex_);
+    const ProjectTables old_tables = tables_.value(it.key());
+    if (filenames_.contains(it.key()) &&
+        (Generation(old_tables.table_) != Generation(tables.table_) ||
+         Generation(old_tables.overlay_) != Generation(tables.overlay_))) {
+      tables_[it.key()] = tables;
+    }
+  }
+}
+
+bool SymbolTables::IsEmpty() const {
+  QMutexLocker l(&mutex_);
+  return tables_.isEmpty() && library_tables_.isEmpty();
+}
+
+QList<SymbolTable::Result> SymbolTables::Search(
+    const QString& query, const QString& file_path,
+    pb::SymbolType type, int limit) const {
+  QList<ProjectTables> projects;
+  QList<QSharedPointer<const SymbolTable> > libraries;
+  {
+    QMutexLocker l(&mutex_);
+    projects = tables_.values();
+    libraries = library_tables_.values();
+  }
+
+  // Each table returns its own best results, which are merged by rank.  The
+  // sort is stable so projects' symbols come before libraries' on a tie.
+  QList<SymbolTable::Result> ret;
+  foreach (const ProjectTables& project, projects) {
+    ret.append(project.table_->Search(query, file_path, type, limit,
+                                      project.hidden_files_));
+    if (project.overlay_) {
+      ret.append(project.overlay_->Search(query, file_path, type, limit));
+    }
+  }
+  foreach (const QSharedPointer<const SymbolTable>& table, libraries) {
+    ret.append(table->Search(query, file_path, type, limit));
+  }
+
+  std::stable_sort(ret.begin(), ret.end(),
+                   [](const SymbolTable::Result& a,
+                      const SymbolTable::Result& b) {
+    if (a.prefix_match_ != b.prefix_match_) {
+      return a.prefix_match_;
+    }
+    return a.symbol_name_.length() < b.symbol_name_.length();
+  });
+
+  if (ret.count() > limit) {
+    ret.erase(ret.begin() + limit, ret.end());
+  }
+  return ret;
+}
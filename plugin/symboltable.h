@@ -0,0 +1,166 @@
+/*  pyqtc - QtCreator plugin with code completion using rope.
+    Copyright 2011 David Sansome <me@davidsansome.com>
+    Copyright 2017 Alexander Izmailov <yarolig@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "rpc.pb.h"
+
+#include <QBitArray>
+#include <QFile>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+namespace pyqtc {
+
+// A read-only, memory-mapped copy of a project's symbol index, written by
+// SymbolIndex.ExportTable() in the worker.  Searching it doesn't involve the
+// worker at all.
+class SymbolTable {
+public:
+  struct Result {
+    QString module_name_;
+    QString file_path_;
+    int line_number_;
+    QString symbol_name_;
+    pb::SymbolType symbol_type_;
+
+    // True if the query starts the name or one of its dotted parts.
+    bool prefix_match_;
+  };
+
+  // Returns NULL if the file doesn't exist or isn't a valid symbol table.
+  static QSharedPointer<const SymbolTable> Open(const QString& filename);
+
+  quint32 generation() const { return generation_; }
+
+  // Finds symbols whose names contain query, case-insensitively.  Returns the
+  // best limit of them, ranked the same way as the worker's searches: names
+  // where the query starts the name or a dotted part of it come first, then
+  // shorter names.  If file_path is not empty only symbols in that file are
+  // returned.  Symbols in the files set in hidden_files are skipped.
+  QList<Result> Search(const QString& query, const QString& file_path,
+                       pb::SymbolType type, int limit,
+                       const QBitArray& hidden_files = QBitArray()) const;
+
+  // Returns a bit for each of this table's files, set if other has the same
+  // file.
+  QBitArray FilesIn(const SymbolTable& other) const;
+
+private:
+  SymbolTable(const QString& filename);
+
+  bool Map();
+
+  quint32 ReadUInt32(quint32 offset) const;
+  QByteArray String(quint32 record_offset) const;
+  QString DecodedString(quint32 record_offset) const;
+
+  quint32 SymbolRecord(quint32 index) const;
+  quint32 FileRecord(quint32 index) const;
+
+  struct Match {
+    bool operator <(const Match& other) const;
+
+    bool prefix_match_;
+    quint32 name_length_;
+    quint32 index_;
+  };
+
+  bool FindPostings(quint32 trigram, quint32* first, quint32* count) const;
+  void FindPrefixRange(const QByteArray& needle, quint32* begin,
+                       quint32* end) const;
+  bool IsWanted(quint32 index, qint64 file_id, pb::SymbolType type,
+                const QBitArray& hidden_files) const;
+  void AddMatch(quint32 index, const QByteArray& needle,
+                QVector<Match>* matches) const;
+  Result MakeResult(const Match& match) const;
+
+private:
+  QFile file_;
+  const uchar* data_;
+  qint64 size_;
+
+  quint32 generation_;
+  quint32 file_count_;
+  quint32 symbol_count_;
+  quint32 trigram_count_;
+  quint32 files_offset_;
+  quint32 symbols_offset_;
+  quint32 trigrams_offset_;
+  quint32 postings_offset_;
+  quint32 strings_offset_;
+};
+
+
+// The symbol tables of all open projects.  A table is replaced as a whole
+// when the worker writes a new generation, and searches hold a reference to
+// the tables they started with, so the locator's thread never sees a partly
+// updated table.
+//
+// A project can also have an overlay table with just the files saved since
+// its main table was written.  Its symbols replace the main table's symbols
+// in those files.
+class SymbolTables {
+public:
+  // overlay_filename is empty if the project has no overlay.
+  void Load(const QString& project_root, const QString& filename,
+            const QString& overlay_filename = QString());
+  void Remove(const QString& project_root);
+
+  // Loads the table of a standard library or site-packages directory.  These
+  // are shared by all projects, never change, and are searched after the
+  // projects' own tables.
+  void LoadLibrary(const QString& filename);
+
+  // Maps any tables that the worker has rewritten since they were loaded.
+  void Reload();
+
+  bool IsEmpty() const;
+
+  // Searches every table and returns the best limit results from all of them,
+  // ranked the same way as SymbolTable::Search.
+  QList<SymbolTable::Result> Search(const QString& query,
+                                    const QString& file_path,
+                                    pb::SymbolType type, int limit) const;
+
+private:
+  struct ProjectTables {
+    QSharedPointer<const SymbolTable> table_;
+    QSharedPointer<const SymbolTable> overlay_;
+
+    // The files of table_ that are in overlay_.
+    QBitArray hidden_files_;
+  };
+
+  struct Filenames {
+    QString table_;
+    QString overlay_;
+  };
+
+  static ProjectTables Open(const Filenames& filenames);
+
+  mutable QMutex mutex_;
+  QMap<QString, Filenames> filenames_;
+  QMap<QString, ProjectTables> tables_;
+  QMap<QString, QSharedPointer<const SymbolTable> > library_tables_;
+};
+
+} // namespace pyqtc
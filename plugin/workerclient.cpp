@@ -47,7 +47,8 @@ WorkerClient::ReplyType* WorkerClient::DestroyProject(const QString& project_roo
 
 WorkerClient::ReplyType* WorkerClient::Completion(const QString& file_path,
                                                   const QString& source_text,
-                                                  int cursor_position) {
+                                                  int cursor_position,
+                                                  int max_proposals) {
   pb::Message message;
   pb::CompletionRequest* req = message.mutable_completion_request();
 
@@ -55,6 +56,10 @@ WorkerClient::ReplyType* WorkerClient::Completion(const QString& file_path,
   req->mutable_context()->set_source_text(QStringToProtoString(source_text));
   req->mutable_context()->set_cursor_position(cursor_position);
 
+  if (max_proposals > 0) {
+    req->set_max_proposals(max_proposals);
+  }
+
   return SendMessageWithReply(&message);
 }
 
@@ -84,6 +89,19 @@ WorkerClient::ReplyType* WorkerClient::DefinitionLocation(const QString& file_pa
   return SendMessageWithReply(&message);
 }
 
+WorkerClient::ReplyType* WorkerClient::SymbolInfo(const QString& file_path,
+                                                  const QString& source_text,
+                                                  int cursor_position) {
+  pb::Message message;
+  pb::SymbolInfoRequest* req = message.mutable_symbol_info_request();
+
+  req->mutable_context()->set_file_path(QStringToProtoString(file_path));
+  req->mutable_context()->set_source_text(QStringToProtoString(source_text));
+  req->mutable_context()->set_cursor_position(cursor_position);
+
+  return SendMessageWithReply(&message);
+}
+
 WorkerClient::ReplyType* WorkerClient::RebuildSymbolIndex(const QString& project_root) {
   pb::Message message;
   pb::RebuildSymbolIndexRequest* req = message.mutable_rebuild_symbol_index_request();
@@ -93,11 +111,33 @@ WorkerClient::ReplyType* WorkerClient::RebuildSymbolIndex(const QString& project
   return SendMessageWithReply(&message);
 }
 
-WorkerClient::ReplyType* WorkerClient::UpdateSymbolIndex(const QString& file_path) {
+WorkerClient::ReplyType* WorkerClient::CancelIndex(const QString& project_root) {
+  pb::Message message;
+  pb::CancelIndexRequest* req = message.mutable_cancel_index_request();
+
+  req->set_project_root(QStringToProtoString(project_root));
+
+  return SendMessageWithReply(&message);
+}
+
+WorkerClient::ReplyType* WorkerClient::Cancel(int request_id) {
+  pb::Message message;
+  pb::CancelRequest* req = message.mutable_cancel_request();
+
+  req->set_request_id(request_id);
+
+  return SendMessageWithReply(&message);
+}
+
+WorkerClient::ReplyType* WorkerClient::UpdateSymbolIndex(
+    const QString& project_root, const QStringList& file_paths) {
   pb::Message message;
   pb::UpdateSymbolIndexRequest* req = message.mutable_update_symbol_index_request();
 
-  req->set_file_path(QStringToProtoString(file_path));
+  req->set_project_root(QStringToProtoString(project_root));
+  foreach (const QString& file_path, file_paths) {
+    req->add_file_path(QStringToProtoString(file_path));
+  }
 
   return SendMessageWithReply(&message);
 }
@@ -120,3 +160,11 @@ WorkerClient::ReplyType* WorkerClient::Search(const QString& query,
 
   return SendMessageWithReply(&message);
 }
+
+void WorkerClient::MessageArrived(const pb::Message& message) {
+  if (message.has_index_progress()) {
+    const pb::IndexProgress& progress = message.index_progress();
+    emit IndexProgress(ProtoStringToQString(progress.project_root()),
+                       progress.files_done(), progress.files_total());
+  }
+}
@@ -20,9 +20,13 @@
 #include "messagehandler.h"
 #include "rpc.pb.h"
 
+#include <QStringList>
+
 namespace pyqtc {
 
 class WorkerClient : public AbstractMessageHandler<pb::Message> {
+  Q_OBJECT
+
 public:
   WorkerClient(QIODevice* device, QObject* parent);
 
@@ -30,21 +34,40 @@ public:
   ReplyType* DestroyProject(const QString& project_root);
 
   ReplyType* RebuildSymbolIndex(const QString& project_root);
-  ReplyType* UpdateSymbolIndex(const QString& file_path);
+  ReplyType* CancelIndex(const QString& project_root);
+  ReplyType* UpdateSymbolIndex(const QString& project_root,
+                               const QStringList& file_paths);
 
   ReplyType* Completion(const QString& file_path,
                         const QString& source_text,
-                        int cursor_position);
+                        int cursor_position,
+                        int max_proposals = 0);
   ReplyType* Tooltip(const QString& file_path,
                      const QString& source_text,
                      int cursor_position);
   ReplyType* DefinitionLocation(const QString& file_path,
                                 const QString& source_text,
                                 int cursor_position);
+  ReplyType* SymbolInfo(const QString& file_path,
+                        const QString& source_text,
+                        int cursor_position);
 
   ReplyType* Search(const QString& query,
                     const QString& file_path = QString(),
                     pb::SymbolType type = pb::ALL);
+
+  // Stops the worker handling an earlier request if it hasn't started yet.
+  // That request's reply then fails.
+  ReplyType* Cancel(int request_id);
+
+signals:
+  // Emitted as the worker makes its way through a RebuildSymbolIndex request.
+  void IndexProgress(const QString& project_root, int files_done,
+                     int files_total);
+
+protected:
+  // AbstractMessageHandler
+  void MessageArrived(const pb::Message& message);
 };
 
 } // namespace
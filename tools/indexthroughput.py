@@ -0,0 +1,110 @@
+"""
+Measures how many files per second SymbolIndex.Refresh indexes with different
+numbers of parsing processes, on a generated project.
+
+Run with python2 from the build directory so the parser modules and the
+generated rpc_pb2 are importable:
+
+  PYTHONPATH=parser:../parser python2 ../tools/indexthroughput.py
+"""
+
+import multiprocessing
+import optparse
+import os
+import shutil
+import tempfile
+import time
+
+import rope.base.project
+
+import symbolindex
+
+MODULE = """\
+import os
+
+VALUE = 1
+
+%(classes)s
+def helper_%(index)d(x):
+  return x
+"""
+
+CLASS = """\
+class Class%(index)d(object):
+  def __init__(self, a, b=1):
+    self.a = a
+    self.b = b
+
+%(methods)s
+"""
+
+METHOD = """\
+  def method_%(index)d(self, value):
+    return self.a + value
+"""
+
+
+def CreateProject(root, file_count):
+  for index in xrange(file_count):
+    package = os.path.join(root, "pkg%d" % (index // 100))
+    if not os.path.isdir(package):
+      os.mkdir(package)
+      open(os.path.join(package, "__init__.py"), "w").close()
+
+    classes = "".join(
+        CLASS % {
+          "index": x,
+          "methods": "".join(METHOD % {"index": y} for y in xrange(5)),
+        } for x in xrange(3))
+
+    with open(os.path.join(package, "mod%d.py" % index), "w") as handle:
+      handle.write(MODULE % {"index": index, "classes": classes})
+
+
+def DefaultProcessCounts():
+  ret = []
+  count = 1
+  while count < multiprocessing.cpu_count():
+    ret.append(count)
+    count *= 2
+  ret.append(multiprocessing.cpu_count())
+  return ret
+
+
+def main():
+  parser = optparse.OptionParser()
+  parser.add_option("--files", type="int", default=2000)
+  parser.add_option("--processes", default=None,
+                    help="comma separated process counts to try")
+  options, _ = parser.parse_args()
+
+  if options.processes:
+    process_counts = [int(x) for x in options.processes.split(",")]
+  else:
+    process_counts = DefaultProcessCounts()
+
+  root = tempfile.mkdtemp()
+  try:
+    CreateProject(root, options.files)
+
+    for processes in process_counts:
+      shutil.rmtree(os.path.join(root, ".ropeproject"), ignore_errors=True)
+
+      project = rope.base.project.Project(root)
+      index = symbolindex.SymbolIndex(project, processes=processes)
+
+      start = time.time()
+      index.Refresh()
+      elapsed = time.time() - start
+
+      print "%3d processes  %8.1f files/sec" % (
+          processes, options.files / elapsed)
+
+      index.Close()
+      project.close()
+  finally:
+    shutil.rmtree(root)
+
+
+if __name__ == "__main__":
+  main()
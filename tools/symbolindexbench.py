@@ -0,0 +1,145 @@
+"""
+Compares symbol search latency between the old FTS3 index and the current
+schema on a large synthetic index.
+
+Run with python2 from the build directory so the parser modules and the
+generated rpc_pb2 are importable:
+
+  PYTHONPATH=parser:../parser python2 ../tools/symbolindexbench.py
+"""
+
+import optparse
+import random
+import re
+import sqlite3
+import time
+
+import symbolindex
+
+WORDS = [
+  "get", "set", "create", "update", "remove", "parse", "load", "save",
+  "widget", "item", "model", "view", "index", "symbol", "file", "path",
+  "request", "response", "handler", "manager", "cache", "worker", "project",
+  "buffer", "stream", "token", "node", "tree", "list", "map", "value",
+]
+
+QUERIES = [
+  "get", "wid", "parse_file", "manager.load", "ex", "cache wor", "sym",
+  "item_view", "resp", "node.set",
+]
+
+
+def RandomName(rand):
+  name = "_".join(rand.choice(WORDS) for _ in xrange(rand.randint(1, 3)))
+  if rand.random() < 0.3:
+    name = name.title().replace("_", "")
+  return name
+
+
+def Populate(conn, symbol_count, file_count, legacy):
+  rand = random.Random(0)
+
+  with conn:
+    conn.executemany(
+      "INSERT INTO files (rowid, file_path, module_name) VALUES (?, ?, ?)",
+      ((i, "pkg/mod%d.py" % i, "pkg.mod%d" % i)
+       for i in xrange(1, file_count + 1)))
+
+    for rowid in xrange(1, symbol_count + 1):
+      name = RandomName(rand)
+      if rand.random() < 0.5:
+        name = "%s.%s" % (RandomName(rand).title().replace("_", ""), name)
+
+      fileid = rand.randint(1, file_count)
+      symbol_type = rand.randint(1, 4)
+      line_number = rand.randint(1, 1000)
+
+      if legacy:
+        conn.execute(
+          "INSERT INTO symbols (rowid, fileid, symbol_name, symbol_type, "
+          "line_number) VALUES (?, ?, ?, ?, ?)",
+          (rowid, fileid, name, symbol_type, line_number))
+        conn.execute(
+          "INSERT INTO symbol_index (rowid, content) VALUES (?, ?)",
+          (rowid, name))
+      else:
+        conn.execute("INSERT OR IGNORE INTO names (name) VALUES (?)", (name,))
+        conn.execute(
+          "INSERT INTO symbols (rowid, fileid, nameid, symbol_type, "
+          "line_number) SELECT ?, ?, rowid, ?, ? FROM names WHERE name = ?",
+          (rowid, fileid, symbol_type, line_number, name))
+
+
+class FakeProject(object):
+  """
+  Stands in for the rope project, which Search only needs the address of.
+  """
+
+  address = "/"
+
+
+def LegacySearch(conn, query, limit):
+  # The search as it was before the trigram index.
+  fts_query = re.sub(r'\W+', ' ', query.lower())
+  fts_query = " ".join("%s*" % x for x in fts_query.split(" "))
+
+  return conn.execute("""
+    SELECT f.module_name, f.file_path, s.line_number, s.symbol_name,
+           s.symbol_type
+    FROM files AS f, symbols AS s, symbol_index AS i
+    WHERE i.content MATCH ? AND i.rowid = s.rowid AND s.fileid = f.rowid
+    LIMIT ?
+  """, (fts_query, limit))
+
+
+def CurrentSearch(conn, query, limit):
+  index = symbolindex.SymbolIndex.__new__(symbolindex.SymbolIndex)
+  index.project = FakeProject()
+  index.read_conn = conn
+  return index.Search(query, limit=limit)
+
+
+def Time(name, conn, search, repeats, limit):
+  print name
+  total = 0.0
+
+  for query in QUERIES:
+    best = None
+    for _ in xrange(repeats):
+      start = time.time()
+      count = len(list(search(conn, query, limit)))
+      elapsed = time.time() - start
+      best = elapsed if best is None else min(best, elapsed)
+
+    total += best
+    print "  %-14s %6d results %8.2f ms" % (query, count, best * 1000)
+
+  print "  total %.2f ms" % (total * 1000)
+
+
+def main():
+  parser = optparse.OptionParser()
+  parser.add_option("--symbols", type="int", default=200000)
+  parser.add_option("--files", type="int", default=5000)
+  parser.add_option("--repeats", type="int", default=5)
+  parser.add_option("--limit", type="int", default=1000)
+  options, _ = parser.parse_args()
+
+  legacy = sqlite3.connect(":memory:")
+  legacy.executescript(symbolindex.SymbolIndex.SCHEMA[0])
+
+  current = sqlite3.connect(":memory:")
+  for script in symbolindex.SymbolIndex.SCHEMA:
+    current.executescript(script)
+
+  for conn in (legacy, current):
+    start = time.time()
+    Populate(conn, options.symbols, options.files, conn is legacy)
+    print "populated in %.2f s" % (time.time() - start)
+
+  Time("fts3 prefix", legacy, LegacySearch, options.repeats, options.limit)
+  Time("fts5 trigram", current, CurrentSearch, options.repeats, options.limit)
+
+
+if __name__ == "__main__":
+  main()
@@ -0,0 +1,119 @@
+"""
+Compares rope's python source scanning with the C versions in _worderaccel on
+a generated module, checking they give the same results.
+
+Each iteration changes one character of the buffer first, like typing does,
+so rope's caches don't hide the cost.
+
+Run with python2 from the build directory so the parser modules and the
+extension are importable:
+
+  PYTHONPATH=parser:../parser python2 ../tools/worderbench.py
+"""
+
+import optparse
+import time
+
+from rope.base import simplify, worder
+
+import worderaccel
+
+MODULE_HEADER = """\
+# -*- coding: utf-8 -*-
+import os
+import sys
+
+"""
+
+CLASS = """\
+class Class%(index)d(object):
+  \"\"\"
+  Docstring for Class%(index)d; it has 'quotes' in it.
+  \"\"\"
+
+  def __init__(self, a, b=(1, 2,
+                           3)):
+    self.a = a  # a comment
+    self.b = [b, "string %%s" %% a,
+              r'raw\\string']
+
+  def method(self, value):
+    return os.path.join(self.a, value) + \\
+        sys.argv[0]; x = {'key': value}
+
+"""
+
+
+def CreateModule(lines):
+  ret = [MODULE_HEADER]
+  count = MODULE_HEADER.count("\n")
+  index = 0
+  while count < lines:
+    text = CLASS % {"index": index}
+    ret.append(text)
+    count += text.count("\n")
+    index += 1
+  return "".join(ret)
+
+
+def Edits(code, iterations):
+  """
+  Yields (code, offset) pairs, each with a different character at the offset.
+  """
+
+  offset = code.rindex("sys.argv") + len("sys.argv")
+  for i in xrange(iterations):
+    yield code[:offset - 1] + "vw"[i % 2] + code[offset:], offset
+
+
+def Request(code, offset):
+  """
+  The scanning a completion request at offset does.
+  """
+
+  finder = worder.Worder(code)
+  return (
+    finder.get_primary_at(offset),
+    finder.get_word_range(offset),
+    finder.get_splitted_primary_before(offset),
+    simplify.ignored_regions(code)[-1],
+  )
+
+
+def Time(code, iterations):
+  results = []
+  start = time.time()
+  for edited, offset in Edits(code, iterations):
+    results.append(Request(edited, offset))
+  return (time.time() - start) / iterations, results
+
+
+def main():
+  parser = optparse.OptionParser()
+  parser.add_option("--lines", type="int", default=10000)
+  parser.add_option("--iterations", type="int", default=20)
+  options, _ = parser.parse_args()
+
+  code = CreateModule(options.lines)
+
+  for name, convert in (("str", str), ("unicode", unicode)):
+    python_time, python_results = Time(convert(code), options.iterations)
+
+    if not worderaccel.WorderAccelerator().Install():
+      print "_worderaccel is not built"
+      return
+
+    accel_time, accel_results = Time(convert(code), options.iterations)
+    reload(simplify)
+    reload(worder)
+
+    if python_results != accel_results:
+      print "%-8s results differ" % name
+      continue
+
+    print "%-8s python %7.2f ms  C %7.2f ms  %5.1fx" % (
+        name, python_time * 1000, accel_time * 1000, python_time / accel_time)
+
+
+if __name__ == "__main__":
+  main()